@@ -0,0 +1,103 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+
+#include "config.h"
+#include "ramfunc.h"
+#include "blackbox.h"
+
+
+#define BLACKBOX_MAGIC  0x424c4b42
+
+
+// Kept in RAM that isn't cleared at startup, so a snapshot taken when
+// a fault happened can still be read out after a reset
+static struct
+{
+	uint32_t magic;
+	uint8_t frozen;
+	uint8_t fault;
+	uint16_t next;
+	uint32_t ticks;
+	blackbox_sample_t samples[BLACKBOX_SAMPLES];
+} blackbox __attribute__((section(".noinit")));
+
+
+void blackbox_init(uint8_t power_on)
+{
+	// Anything other than a snapshot frozen before a reset is garbage
+	if(power_on || blackbox.magic != BLACKBOX_MAGIC || !blackbox.frozen ||
+	   blackbox.next >= BLACKBOX_SAMPLES)
+	{
+		blackbox_release();
+	}
+}
+
+RAMFUNC void blackbox_record(const blackbox_sample_t* sample)
+{
+	if(blackbox.frozen)
+		return;
+
+	blackbox.samples[blackbox.next] = *sample;
+	if(++blackbox.next == BLACKBOX_SAMPLES)
+		blackbox.next = 0;
+}
+
+RAMFUNC void blackbox_freeze(uint8_t fault, uint32_t ticks)
+{
+	// Only the first fault is kept, until it's been read out
+	if(blackbox.frozen)
+		return;
+
+	blackbox.fault = fault;
+	blackbox.ticks = ticks;
+	blackbox.frozen = 1;
+}
+
+void blackbox_release()
+{
+	blackbox.frozen = 0;
+	blackbox.fault = 0;
+	blackbox.ticks = 0;
+	blackbox.next = 0;
+	for(uint16_t i = 0; i < BLACKBOX_SAMPLES; ++i)
+		blackbox.samples[i] = (blackbox_sample_t){ 0 };
+	blackbox.magic = BLACKBOX_MAGIC;
+}
+
+uint8_t blackbox_fault()
+{
+	return blackbox.frozen ? blackbox.fault : 0;
+}
+
+uint32_t blackbox_ticks()
+{
+	return blackbox.ticks;
+}
+
+const blackbox_sample_t* blackbox_get(uint16_t age)
+{
+	// age 0 is the last sample before the fault
+	if(age >= BLACKBOX_SAMPLES)
+		return 0;
+	uint16_t index = (blackbox.next + BLACKBOX_SAMPLES - 1 - age) % BLACKBOX_SAMPLES;
+	return &blackbox.samples[index];
+}
@@ -0,0 +1,23 @@
+// One control loop tick
+typedef struct
+{
+	int16_t encoder_diff;   // spindle encoder counts
+	int16_t steps;          // carriage steps issued
+	int16_t lag;            // servo target minus position, saturated
+	uint8_t flags;          // BLACKBOX_FLAG_ bits, cycle and hold states
+	uint8_t load;           // control loop cycles / 512, saturated
+} blackbox_sample_t;
+
+#define BLACKBOX_FLAG_ALARM     0x01
+#define BLACKBOX_FLAG_ENABLED   0x02
+#define BLACKBOX_CYCLE_SHIFT    2
+#define BLACKBOX_HOLD_SHIFT     5
+#define BLACKBOX_FLAG_MISCOUNT  0x80
+
+void blackbox_init(uint8_t power_on);
+void blackbox_record(const blackbox_sample_t* sample);
+void blackbox_freeze(uint8_t fault, uint32_t ticks);
+void blackbox_release();
+uint8_t blackbox_fault();
+uint32_t blackbox_ticks();
+const blackbox_sample_t* blackbox_get(uint16_t age);
@@ -22,42 +22,106 @@
 #include <stm32f103x6.h>
 #include <system_stm32f1xx.h>
 
+#include "ramfunc.h"
 #include "clock.h"
 
 
 volatile uint32_t ticks = 0;
 
 
+#define HSI_MHZ             8
+#define HSE_STARTUP_TIMEOUT 20    // ms, usually ready in 2
+#define PLL_LOCK_TIMEOUT    2     // ms, typically 200us
+
+
+static uint8_t clock_source = CLOCK_HSE;
+static uint32_t clock_startup_us = 0;
+
+
+// Waits on a clock ready flag for so long, timed by the cycle counter
+// which is still running from the 8MHz HSI at this point
+static uint8_t wait_ready(volatile uint32_t* reg, uint32_t mask, uint32_t timeout_ms)
+{
+	uint32_t start = DWT->CYCCNT;
+	while((*reg & mask) == 0)
+	{
+		if(DWT->CYCCNT - start > timeout_ms * 1000 * HSI_MHZ)
+			return 0;
+	}
+	return 1;
+}
+
 void clock_init (void)
 {
+	// enable the cycle counter for timing code, and the startup here
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
 	// enable HSE
 	RCC->CR |= 0x10001;
-	while((RCC->CR & 0x20000) == 0)
-		;
+	if(!wait_ready(&RCC->CR, 0x20000, HSE_STARTUP_TIMEOUT))
+	{
+		// no crystal, so carry on from HSI at 64MHz rather than hanging
+		RCC->CR &= ~0x10000;
+		clock_source = CLOCK_HSI;
+	}
 	// enable flash prefetch
 	FLASH->ACR = 0x12;
 	// config pll
-	RCC->CFGR |= 0x1d0400; // pll=72MHz, APB1=36MHz, PHB=72MHz
+	if(clock_source == CLOCK_HSE)
+		RCC->CFGR |= 0x1d0400; // pll=72MHz, APB1=36MHz, PHB=72MHz
+	else
+		RCC->CFGR |= 0x380400; // pll=HSI/2*16=64MHz, APB1=32MHz
 	RCC->CR |= 0x1000000; //enable pll
-	while((RCC->CR & 0x3000000) == 0)
-		;
-	// set sysclock as pll
-	RCC->CFGR |= 2;
-	while((RCC->CFGR & 0x8) == 0)
-		;
+	if(!wait_ready(&RCC->CR, 0x2000000, PLL_LOCK_TIMEOUT))
+	{
+		// stay on HSI at 8MHz, slow but still working
+		clock_source = CLOCK_HSI_NO_PLL;
+	}
+	else
+	{
+		// set sysclock as pll
+		RCC->CFGR |= 2;
+		while((RCC->CFGR & 0x8) == 0)
+			;
+	}
+	clock_startup_us = DWT->CYCCNT / HSI_MHZ;
 
 	//Update SystemCoreClock variable according to Clock Register Values.
 	SystemCoreClockUpdate();
+	DWT->CYCCNT = 0;
+}
+
+// Starts the 1ms tick, and with it the control loop
+void clock_start (void)
+{
 	SysTick_Config(SystemCoreClock / 1000U); // seconds
 	__enable_irq();
 }
 
+uint8_t clock_get_source(void)
+{
+	return clock_source;
+}
+
+// Microseconds since reset, good for the first minute or so
+uint32_t clock_boot_us(void)
+{
+	return clock_startup_us + DWT->CYCCNT / (SystemCoreClock / 1000000);
+}
+
 
 uint32_t get_ticks(void)
 {
 	return ticks;
 }
 
+RAMFUNC uint32_t get_cycles(void)
+{
+	return DWT->CYCCNT;
+}
+
 void delay_msec(int millis) 
 {
 	uint32_t tmp = get_ticks();
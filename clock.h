@@ -1,5 +1,13 @@
+#define CLOCK_HSE         0   // 72MHz from the crystal
+#define CLOCK_HSI         1   // no crystal, 64MHz from the internal clock
+#define CLOCK_HSI_NO_PLL  2   // the PLL didn't lock, 8MHz from the internal clock
+
 
 extern volatile uint32_t ticks;
 void clock_init();
+void clock_start();
+uint8_t clock_get_source(void);
+uint32_t clock_boot_us(void);
 uint32_t get_ticks(void);
+uint32_t get_cycles(void);
 void delay_msec(int millis);
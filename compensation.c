@@ -0,0 +1,262 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+
+#include "config.h"
+#include "ramfunc.h"
+#include "compensation.h"
+
+
+#define STEPS_PER_MM        (DRIVE_RATIO * STEPPER_PULSES / LEADSCREW_PITCH)
+#define SPACING_STEPS       ((uint32_t)(PITCH_COMP_SPACING * STEPS_PER_MM))
+#define SPACING_RECIPROCAL  ((uint32_t)(4294967296.0 / SPACING_STEPS))
+#define STEPS_PER_MICRON    ((int32_t)(STEPS_PER_MM / 1000.0 * (1 << 16)))
+#define START_STEPS         ((int32_t)(PITCH_COMP_START * STEPS_PER_MM))
+
+
+static const int16_t pitch_errors[] = PITCH_COMP_ERRORS;
+
+// Carriage position of the first entry in the table, until a reference is
+// set it's taken from wherever the carriage was at power on
+static int32_t pitch_origin = START_STEPS;
+
+#define PITCH_ERRORS_SIZE   (sizeof(pitch_errors) / sizeof(*pitch_errors))
+
+
+// Returns the number of steps that need adding to the nominal carriage
+// position to correct for the leadscrew pitch error at that position.
+// The cost is the same wherever the carriage is: one divide to find the
+// table entry and a fixed point linear interpolation to the next one.
+// Beyond either end of the table the end entry carries on.
+RAMFUNC int32_t pitch_comp_get(int32_t position)
+{
+	int32_t error;  // microns, 16.16 fixed point
+
+	int32_t offset = position - pitch_origin;
+	if(offset <= 0)
+	{
+		error = pitch_errors[0] * 65536;
+	}
+	else
+	{
+		uint32_t index = (uint32_t)offset / SPACING_STEPS;
+		if(index >= PITCH_ERRORS_SIZE - 1)
+		{
+			error = pitch_errors[PITCH_ERRORS_SIZE - 1] * 65536;
+		}
+		else
+		{
+			uint32_t along = (uint32_t)offset - index * SPACING_STEPS;
+			int32_t fraction = ((uint64_t)along * SPACING_RECIPROCAL) >> 16;
+			error = pitch_errors[index] * 65536 +
+			        (pitch_errors[index + 1] - pitch_errors[index]) * fraction;
+		}
+	}
+
+	// Round to the nearest step and move the opposite way to the error
+	return -(int32_t)(((int64_t)error * STEPS_PER_MICRON + ((int64_t)1 << 31)) >> 32);
+}
+
+// Makes a carriage position the reference point the table was measured
+// from, so that it no longer depends on where the carriage was at power on
+RAMFUNC void pitch_comp_set_reference(int32_t position)
+{
+	pitch_origin = position + START_STEPS;
+}
+
+
+// The spindle encoder's angular error within each turn, from eccentricity
+// and the belt or coupling driving it, is kept as measured minus true angle
+// in arc seconds at SPINDLE_COMP_BINS evenly spaced angles from the index.
+#define SPINDLE_COUNTS        ((uint32_t)ENCODER_PULSES)
+#define ARCSEC_PER_TURN       1296000
+#define BIN_RECIPROCAL        ((uint32_t)((uint64_t)SPINDLE_COMP_BINS * 4294967296 / SPINDLE_COUNTS))
+#define COUNTS_PER_ARCSEC     ((int64_t)(ENCODER_PULSES / ARCSEC_PER_TURN * 4294967296.0))
+
+// Learning takes the turns between two index pulses at a steady speed,
+// with times and angles summed in 1/256ths of a ms and of a count
+#define LEARN_OFF             0
+#define LEARN_WAIT            1   // for an index pulse to start a turn
+#define LEARN_TURN            2   // summing up a turn
+#define LEARN_DONE            3   // a turn for spindle_comp_update()
+#define LEARN_MAX_TIME        (4096 * 256)   // 1/256 ms, slowest turn, about 15 rpm
+#define LEARN_MIN_SAMPLES     2              // per bin, which limits the fastest turn
+#define LEARN_SPEED_TOLERANCE 128            // a turn can differ by 1/128th from the last
+
+
+static int16_t spindle_errors[SPINDLE_COMP_BINS] = SPINDLE_COMP_ERRORS;
+
+static volatile uint8_t learn_state = LEARN_OFF;
+static uint16_t learn_turns = 0;
+static uint16_t learn_target = 0;
+static int32_t learn_sums[SPINDLE_COMP_BINS];      // 1/256 counts, summed over turns
+static uint32_t turn_start = 0;                    // 1/256 ms
+static uint32_t turn_time = 0;
+static uint32_t last_turn_time = 0;
+static uint16_t bin_samples[SPINDLE_COMP_BINS];
+static uint32_t bin_times[SPINDLE_COMP_BINS];      // 1/256 ms since the index
+static uint32_t bin_angles[SPINDLE_COMP_BINS];     // 1/256 counts since the index
+
+
+// Returns the 16.16 counts that need adding to the encoder position to
+// correct for the encoder's error at an angle, in 16.16 counts on from the
+// index. Like the pitch compensation it costs the same at any angle: a
+// multiply to find the entry and an interpolation to the next one round.
+RAMFUNC int32_t spindle_comp_get(uint32_t angle)
+{
+	uint32_t position = ((uint64_t)angle * BIN_RECIPROCAL) >> 32;    // 16.16 bins
+	uint32_t index = (position >> 16) % SPINDLE_COMP_BINS;
+	uint32_t next = (index + 1) % SPINDLE_COMP_BINS;
+	int32_t fraction = position & 0xffff;
+	int32_t error = spindle_errors[index] * 65536 +
+	                (spindle_errors[next] - spindle_errors[index]) * fraction;
+
+	return -(int32_t)(((int64_t)error * COUNTS_PER_ARCSEC) >> 32);
+}
+
+// Sums up the angle against time for each bin over a turn of the spindle,
+// called every tick with the time in ms, the uncorrected angle in 16.16
+// counts from the index and the velocity in 16.16 counts per ms. At an
+// index pulse the time it actually came is worked back from the angle
+// since, so that the length of the turn isn't rounded to a tick.
+RAMFUNC void spindle_comp_learn(uint32_t time, uint32_t angle, int32_t velocity, uint8_t index)
+{
+	if(learn_state == LEARN_OFF || learn_state == LEARN_DONE)
+		return;
+	if(velocity <= 0)
+	{
+		learn_state = LEARN_WAIT;
+		return;
+	}
+
+	if(index)
+	{
+		uint32_t index_time = time * 256 - (uint32_t)(((uint64_t)angle << 8) / (uint32_t)velocity);
+		if(learn_state == LEARN_TURN)
+		{
+			turn_time = index_time - turn_start;
+			learn_state = LEARN_DONE;
+			return;
+		}
+		for(uint8_t i = 0; i < SPINDLE_COMP_BINS; ++i)
+		{
+			bin_samples[i] = 0;
+			bin_times[i] = 0;
+			bin_angles[i] = 0;
+		}
+		turn_start = index_time;
+		learn_state = LEARN_TURN;
+	}
+
+	if(learn_state != LEARN_TURN)
+		return;
+	uint32_t since = time * 256 - turn_start;
+	if(since > LEARN_MAX_TIME)
+	{
+		learn_state = LEARN_WAIT;
+		return;
+	}
+
+	// Each bin is centred on its table entry
+	uint32_t position = ((uint64_t)angle * BIN_RECIPROCAL) >> 32;
+	uint32_t bin = ((position + 0x8000) >> 16) % SPINDLE_COMP_BINS;
+	bin_samples[bin] += 1;
+	bin_times[bin] += since;
+	bin_angles[bin] += angle >> 8;
+}
+
+// Starts learning the encoder's error over a number of turns, or stops
+// it with none. The spindle needs to be turning forwards at a steady speed
+// of between about 15rpm and a few hundred.
+void spindle_comp_start(uint16_t turns)
+{
+	learn_state = LEARN_OFF;
+	for(uint8_t i = 0; i < SPINDLE_COMP_BINS; ++i)
+		learn_sums[i] = 0;
+	learn_turns = 0;
+	learn_target = turns;
+	last_turn_time = 0;
+	if(turns > 0)
+		learn_state = LEARN_WAIT;
+}
+
+// Fits a turn that the control loop has finished summing, from the main
+// loop. At a steady speed the true angle goes up in step with time from
+// the index, so whatever is left of each bin's angle after taking that
+// off is the encoder's error there, give or take an offset that makes the
+// error over the whole turn average out to nothing. Returns the turns
+// still to go, and fills in the table once there are none.
+uint16_t spindle_comp_update()
+{
+	if(learn_state != LEARN_DONE)
+		return learn_state == LEARN_OFF ? 0 : learn_target - learn_turns;
+
+	// Only turns at the same speed as the one before count
+	uint32_t time = turn_time;
+	uint32_t last_time = last_turn_time;
+	last_turn_time = time;
+	uint32_t change = time > last_time ? time - last_time : last_time - time;
+	uint8_t steady = change <= time / LEARN_SPEED_TOLERANCE;
+
+	int64_t total_angle = 0;
+	int64_t total_time = 0;
+	int32_t total_samples = 0;
+	for(uint8_t i = 0; i < SPINDLE_COMP_BINS; ++i)
+	{
+		if(bin_samples[i] < LEARN_MIN_SAMPLES)
+			steady = 0;
+		total_angle += bin_angles[i];
+		total_time += bin_times[i];
+		total_samples += bin_samples[i];
+	}
+
+	if(steady)
+	{
+		int64_t turn = (int64_t)SPINDLE_COUNTS * 256;
+		int32_t offset = (total_angle - turn * total_time / time) / total_samples;
+		for(uint8_t i = 0; i < SPINDLE_COMP_BINS; ++i)
+		{
+			int64_t error = bin_angles[i] - turn * bin_times[i] / time;
+			learn_sums[i] += error / bin_samples[i] - offset;
+		}
+		++learn_turns;
+	}
+
+	if(learn_turns < learn_target)
+	{
+		learn_state = LEARN_WAIT;
+		return learn_target - learn_turns;
+	}
+
+	for(uint8_t i = 0; i < SPINDLE_COMP_BINS; ++i)
+	{
+		int64_t error = (int64_t)learn_sums[i] * ARCSEC_PER_TURN / learn_turns;
+		spindle_errors[i] = (error + (error < 0 ? -1 : 1) * (int64_t)SPINDLE_COUNTS * 128) /
+		                    ((int64_t)SPINDLE_COUNTS * 256);
+	}
+	learn_state = LEARN_OFF;
+	return 0;
+}
+
+int16_t spindle_comp_error(uint8_t bin)
+{
+	return spindle_errors[bin];
+}
@@ -0,0 +1,8 @@
+
+int32_t pitch_comp_get(int32_t position);
+void pitch_comp_set_reference(int32_t position);
+int32_t spindle_comp_get(uint32_t angle);
+void spindle_comp_learn(uint32_t time, uint32_t angle, int32_t velocity, uint8_t index);
+void spindle_comp_start(uint16_t turns);
+uint16_t spindle_comp_update();
+int16_t spindle_comp_error(uint8_t bin);
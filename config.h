@@ -4,6 +4,73 @@
 #define FEEDSCREW_PITCH  (LEADSCREW_PITCH * 0.18)
 #define DRIVE_RATIO      4.0
 
+#define BACKLASH         0.0     // mm of leadscrew travel lost on reversal
+#define BACKLASH_RATE    20      // max backlash steps added per millisecond
+
+// Leadscrew pitch error, measured as actual minus expected carriage travel
+// in microns at every PITCH_COMP_SPACING mm, with the first entry at
+// PITCH_COMP_START mm from a reference point on the bed, positive being
+// the way the carriage goes for a forward pitch. Make it negative to cover
+// travel both sides of the reference. Put the carriage at the reference
+// and use the pitchref console command to line the table up, otherwise
+// the reference is wherever the carriage was at power on. A table of zeros
+// disables the compensation.
+#define PITCH_COMP_SPACING  25.0
+#define PITCH_COMP_START    0.0
+#define PITCH_COMP_ERRORS   { 0 }
+
+// Spindle encoder angular error within a turn, from eccentricity and the
+// belt or coupling driving it, as measured minus true angle in arc seconds
+// at SPINDLE_COMP_BINS evenly spaced angles on from the index pulse on PB0,
+// which isn't wired on the PCB, see README.
+// Learn it with the spincomp console command and paste the result in here.
+#define SPINDLE_COMP_BINS   32
+#define SPINDLE_COMP_ERRORS { 0 }
+
+#define ACCELERATION     100.0   // mm/s/s of leadscrew travel for stops and rapids
+#define RAPID_SPEED      13.0    // mm/s of leadscrew travel for rapid moves, up to 111 steps per ms
+#define JOG_SPEED        10.0    // mm/s of leadscrew travel when jogging
+#define PITCH_MIN_RPM    100     // pitches too coarse to follow the spindle at this speed are refused
+
+// An encoder with sine and cosine outputs, 0 to 3.3V about a 1.65V middle,
+// sine on PA3 and cosine on PB1, which aren't wired on the PCB (see README),
+// as well as squared up to A and B on PB4 and PB5 for the count. The angle
+// between them gives the position to a small fraction of a count.
+// SPINDLE_ANALOG_PHASE lines the angle up with the count, 65536 to a cycle
+// of 4 counts, and only needs to be right to within a count or so.
+// Positions are kept to within SPINDLE_ANALOG_DEADBAND in 16.16 counts so
+// that noise doesn't look like the spindle turning.
+// Needs SPINDLE_INTERPOLATE.
+#define SPINDLE_ANALOG          FALSE
+#define SPINDLE_ANALOG_PHASE    0
+#define SPINDLE_ANALOG_DEADBAND 256
+
+#define HARDWARE_GEARING  FALSE  // leave whole steps per encoder A cycle to the timers
+#define SPINDLE_INTERPOLATE TRUE  // move on between encoder counts, for low speeds or few counts
+#define SPINDLE_IDLE_TIME  500    // ms of nothing moving before the control loop idles
+#define IDLE_TICK_INTERVAL 10     // ms between control loop runs when idle
+#define SERVO_IDLE_DISABLE FALSE  // turn the servo enable output off when idle, needs PA11 wiring
+#define SERVO_ENABLE_TIME  20     // ms for the servo to be ready after enabling
+
+// Motor position fed back from the servo driver's encoder output on PB8 (A)
+// and PB9 (B), which aren't wired on the PCB (see README), in counts per
+// turn of the motor counting every edge, or 0 for none. Every edge is an
+// interrupt so divide it down in the driver if it can be, to no finer
+// than a step.
+#define FEEDBACK_PULSES    0
+#define FEEDBACK_REVERSE   FALSE  // it counts down when the motor steps forwards
+#define FEEDBACK_MAX_ERROR 0      // steps out before stopping with a fault, 0 for never
+#define FEEDBACK_SETTLE_TIME 100  // ms after the last step that the motor should be still
+
+#define STEP_AUDIT_FAULT   FALSE  // stop with a fault when the step pulses made don't match those asked for
+
+#define WATCHDOG_TIMEOUT    250  // ms without a check in before the watchdog resets
+#define WATCHDOG_STALL_TIME 50   // ms without the main loop before stopping the servo
+
+#define BLACKBOX_SAMPLES    256  // control loop ticks kept from before a fault
+
+#define SERIAL_BAUD         460800  // telemetry and console on PB6 (TX) and PB7 (RX), not wired on the PCB, see README
+
 #define REVERSE_DIRECTION TRUE
 
 #define DEFAULT_UNIT    0
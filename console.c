@@ -0,0 +1,191 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+
+#include "config.h"
+#include "serial.h"
+#include "watchdog.h"
+#include "console.h"
+
+
+#define LINE_LENGTH  120
+
+
+static char input[LINE_LENGTH + 1];
+static uint8_t input_length = 0;
+static uint32_t output[1 + LINE_LENGTH / 4];
+static uint8_t output_length = 0;
+
+
+// Returns a complete line once one has been received, otherwise 0
+char* console_read_line()
+{
+	int16_t byte;
+	while((byte = serial_read()) >= 0)
+	{
+		if(byte == '\r' || byte == '\n')
+		{
+			if(input_length == 0)
+				continue;
+			input[input_length] = 0;
+			input_length = 0;
+			return input;
+		}
+		if(input_length < LINE_LENGTH)
+			input[input_length++] = byte;
+	}
+
+	return 0;
+}
+
+// Returns the next space separated word and moves line past it, or 0
+// when there are no more
+char* console_next_word(char** line)
+{
+	char* word = *line;
+	while(*word == ' ')
+		++word;
+	if(*word == 0)
+		return 0;
+
+	char* end = word;
+	while(*end != 0 && *end != ' ')
+		++end;
+	if(*end != 0)
+		*end++ = 0;
+	*line = end;
+
+	return word;
+}
+
+uint8_t console_match(const char* word, const char* command)
+{
+	if(word == 0)
+		return 0;
+	while(*word != 0 && *word == *command)
+	{
+		++word;
+		++command;
+	}
+	return *word == *command;
+}
+
+// Parses a decimal number such as -1.25 into an integer scaled up by
+// the given number of decimal places, extra places are ignored. Numbers
+// that don't fit in an int32_t once scaled up are refused.
+uint8_t console_parse_number(const char* word, uint8_t decimals, int32_t* value)
+{
+	if(word == 0)
+		return 0;
+
+	uint8_t negative = *word == '-';
+	if(negative)
+		++word;
+
+	int32_t result = 0;
+	int8_t places = -1;
+	uint8_t digits = 0;
+	for(; *word != 0; ++word)
+	{
+		if(*word == '.' && places < 0)
+		{
+			places = 0;
+		}
+		else if(*word >= '0' && *word <= '9')
+		{
+			if(places >= decimals)
+				continue;
+			if(result > (INT32_MAX - (*word - '0')) / 10)
+				return 0;
+			result = result * 10 + (*word - '0');
+			if(places >= 0)
+				++places;
+			++digits;
+		}
+		else
+		{
+			return 0;
+		}
+	}
+	if(digits == 0)
+		return 0;
+
+	for(int8_t i = places < 0 ? 0 : places; i < decimals; ++i)
+	{
+		if(result > INT32_MAX / 10)
+			return 0;
+		result *= 10;
+	}
+	*value = negative ? 0 - result : result;
+
+	return 1;
+}
+
+void console_write(const char* text)
+{
+	uint8_t* bytes = (uint8_t*)&output[1];
+	while(*text != 0 && output_length < LINE_LENGTH)
+		bytes[output_length++] = *text++;
+}
+
+void console_write_unsigned(uint64_t value, uint8_t decimals)
+{
+	char text[23];
+	uint8_t pos = sizeof(text) - 1;
+
+	text[pos] = 0;
+	do
+	{
+		text[--pos] = '0' + value % 10;
+		value /= 10;
+		if(--decimals == 0)
+			text[--pos] = '.';
+	}
+	while(value != 0 || (int8_t)decimals >= 0);
+
+	console_write(&text[pos]);
+}
+
+void console_write_number(int32_t value, uint8_t decimals)
+{
+	if(value < 0)
+		console_write("-");
+	console_write_unsigned(value < 0 ? 0 - (uint32_t)value : (uint32_t)value, decimals);
+}
+
+// Sends what has been written as one line, waiting for the serial port
+// if it's still busy with the last frame
+void console_end_line()
+{
+	output[0] = SERIAL_FRAME_CONSOLE | (output_length << 8);
+	while(output_length & 3)
+		((uint8_t*)&output[1])[output_length++] = 0;
+
+	while(!serial_send(output, 1 + output_length / 4))
+		watchdog_checkin(WATCHDOG_MAIN);
+	output_length = 0;
+}
+
+void console_line(const char* text)
+{
+	console_write(text);
+	console_end_line();
+}
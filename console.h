@@ -0,0 +1,9 @@
+char* console_read_line();
+char* console_next_word(char** line);
+uint8_t console_match(const char* word, const char* command);
+uint8_t console_parse_number(const char* word, uint8_t decimals, int32_t* value);
+void console_write(const char* text);
+void console_write_unsigned(uint64_t value, uint8_t decimals);
+void console_write_number(int32_t value, uint8_t decimals);
+void console_end_line();
+void console_line(const char* text);
@@ -17,6 +17,8 @@
 #define BLANK 0x0F
 #define POINT 0xF0
 #define ERROR 0x0B
+#define HOLD  0x0C
+#define PAGE  0x0E
 
 
 void display_init();
@@ -0,0 +1,107 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stm32f103x6.h>
+#include <system_stm32f1xx.h>
+
+#include "config.h"
+#include "ramfunc.h"
+#include "feedback.h"
+
+
+#define TRUE  1
+#define FALSE 0
+
+// Motor steps for each feedback count, 32.32 fixed point
+#define STEPS_PER_COUNT  ((int64_t)(FEEDBACK_PULSES > 0 ? STEPPER_PULSES / FEEDBACK_PULSES * 4294967296.0 : 0))
+
+// Change in count from the last state of the inputs, B << 1 | A, to the
+// next. Both changing at once means an edge was missed.
+#define MISSED  2
+
+static const int8_t transitions[16] =
+{
+	0, 1, -1, MISSED,
+	-1, 0, MISSED, 1,
+	1, MISSED, 0, -1,
+	MISSED, -1, 1, 0
+};
+
+
+static volatile int32_t count = 0;
+static volatile uint32_t missed = 0;
+static uint8_t last_state = 0;
+
+
+void feedback_init()
+{
+	if(FEEDBACK_PULSES == 0)
+		return;
+
+	// Configure pins
+	// PB8 = A = pulled up input, not wired on the PCB
+	// PB9 = B = pulled up input, not wired on the PCB
+	RCC->APB2ENR |= RCC_APB2ENR_IOPBEN | RCC_APB2ENR_AFIOEN;
+	GPIOB->CRH &= ~(GPIO_CRH_CNF8 | GPIO_CRH_MODE8 |
+	                GPIO_CRH_CNF9 | GPIO_CRH_MODE9);
+	GPIOB->CRH |= GPIO_CRH_CNF8_1 | GPIO_CRH_CNF9_1;
+	GPIOB->ODR |= GPIO_ODR_ODR8 | GPIO_ODR_ODR9;
+	last_state = (GPIOB->IDR >> 8) & 3;
+
+	// Interrupt on both edges of both, there being no timer left to
+	// decode them. Above everything else so as not to miss an edge.
+	AFIO->EXTICR[2] = (AFIO->EXTICR[2] & ~(AFIO_EXTICR3_EXTI8 | AFIO_EXTICR3_EXTI9)) |
+	                  AFIO_EXTICR3_EXTI8_PB | AFIO_EXTICR3_EXTI9_PB;
+	EXTI->RTSR |= EXTI_RTSR_TR8 | EXTI_RTSR_TR9;
+	EXTI->FTSR |= EXTI_FTSR_TR8 | EXTI_FTSR_TR9;
+	EXTI->PR = EXTI_PR_PR8 | EXTI_PR_PR9;
+	EXTI->IMR |= EXTI_IMR_MR8 | EXTI_IMR_MR9;
+	NVIC_SetPriority(EXTI9_5_IRQn, 0);
+	NVIC_EnableIRQ(EXTI9_5_IRQn);
+}
+
+// One edge on either input. Clearing the pending bits before reading the
+// inputs means an edge that comes in the meantime runs this again rather
+// than being lost.
+RAMFUNC void EXTI9_5_IRQHandler()
+{
+	EXTI->PR = EXTI_PR_PR8 | EXTI_PR_PR9;
+	uint8_t state = (GPIOB->IDR >> 8) & 3;
+	int8_t change = transitions[(last_state << 2) | state];
+	last_state = state;
+	if(change == MISSED)
+		missed += 1;
+	else
+		count += change;
+}
+
+// The motor position in steps from the feedback counts
+RAMFUNC int32_t feedback_get()
+{
+	int32_t steps = ((int64_t)count * STEPS_PER_COUNT) >> 32;
+	return FEEDBACK_REVERSE ? 0 - steps : steps;
+}
+
+// Edges missed for coming too close together
+uint32_t feedback_missed()
+{
+	return missed;
+}
@@ -0,0 +1,4 @@
+
+void feedback_init();
+int32_t feedback_get();
+uint32_t feedback_missed();
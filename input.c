@@ -28,6 +28,7 @@
 
 #define DEBOUNCE_TIME    50
 #define CLICK_COUNT_TIME 250
+#define LONG_PRESS_TIME  750
 
 
 void input_init()
@@ -86,10 +87,19 @@ uint8_t input_button_get()
 			buttonClickCounted = 1;
 			buttonClickCountTime = now;
 		}
+
+		// If a single press is held down then it's a long press rather
+		// than a click, and releasing it afterwards does nothing
+		if(buttonState && buttonClickCount == 1 && now - buttonTransitionTime > LONG_PRESS_TIME)
+		{
+			ret = BUTTON_LONG_PRESS;
+			buttonClickCount = 0;
+		}
 	}
 
-	// If the click count hasn't increased for a while then act on it
-	if(buttonClickCount > 0 && now - buttonClickCountTime > CLICK_COUNT_TIME)
+	// If the click count hasn't increased for a while since the button
+	// was let go then act on it
+	if(buttonClickCount > 0 && !buttonState && now - buttonClickCountTime > CLICK_COUNT_TIME)
 	{
 		ret = buttonClickCount;
 		buttonClickCount = 0;
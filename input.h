@@ -1,4 +1,6 @@
 
+#define BUTTON_LONG_PRESS 0xff
+
 void input_init();
 uint8_t input_button_get();
 int16_t input_encoder_get();
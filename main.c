@@ -27,7 +27,17 @@
 #include "servo.h"
 #include "display.h"
 #include "input.h"
+#include "compensation.h"
+#include "motion.h"
+#include "watchdog.h"
+#include "blackbox.h"
+#include "serial.h"
+#include "telemetry.h"
+#include "console.h"
+#include "ratio.h"
+#include "feedback.h"
 #include "config.h"
+#include "ramfunc.h"
 #include "tables.h"
 
 
@@ -41,41 +51,276 @@
 #define UI_STATE_CHANGE_VALUE    2
 #define UI_STATE_FAULT           3
 
-#define UNITS_MAX    3
+#define UNITS_MAX    6
 #define UNITS_MIN    0
+#define UNITS_JOG    4
+#define UNITS_FEED_RATE 5
+#define UNITS_CUSTOM 6
+
+#define LEDS_JOG       0x1e   // all of the units leds
+#define LEDS_FEED_RATE 0x0a   // both of the feed leds
+#define LEDS_CUSTOM    0x14   // both of the thread leds
+#define UNITS_LEDS(u)  ((u) == UNITS_JOG ? LEDS_JOG : \
+                        (u) == UNITS_FEED_RATE ? LEDS_FEED_RATE : \
+                        (u) == UNITS_CUSTOM ? LEDS_CUSTOM : 1 << ((u) + 1))
+#define UNITS_FOLLOW_SPINDLE(u) ((u) < UNITS_JOG || (u) == UNITS_CUSTOM)
+#define UNITS_INCH(u)           ((u) == 2 || (u) == 3)
+#define UNITS_FEEDSCREW(u)      ((u) == 0 || (u) == 2 || (u) == UNITS_FEED_RATE)
+
+// Stages of dialling in a custom pitch, family then each digit
+#define CUSTOM_STAGE_FAMILY  0
+#define CUSTOM_STAGE_DIGIT   1
+#define CUSTOM_DIGITS        3
+#define CUSTOM_ERROR_TIME    2000
+
+#define PAGE_SETTING     0
+#define PAGE_RPM         1
+#define PAGE_POSITION    2
+#define PAGE_FEED_RATE   3
+#define PAGE_COUNT       4
+#define PAGE_NAME_TIME   1000
+
+#define SPEED_SAMPLES     8
+#define SPEED_SAMPLE_TIME 100
+
+#define DISPLAY_POWER_UP_TIME 5   // ms after reset, the datasheet doesn't say
+
+// Times through startup, for the boot command
+#define BOOT_CLOCK    0
+#define BOOT_CONTROL  1
+#define BOOT_DISPLAY  2
+#define BOOT_READY    3
+#define BOOT_PHASES   4
+
+#define STEPS_PER_MM_THREAD  (DRIVE_RATIO * STEPPER_PULSES / LEADSCREW_PITCH)
+#define STEPS_PER_MM_FEED    (DRIVE_RATIO * STEPPER_PULSES / FEEDSCREW_PITCH)
+#define SCALE_MM(steps)      ((int64_t)(100.0 / (steps) * 4294967296.0))
+#define SCALE_INCH(steps)    ((int64_t)(1000.0 / 25.4 / (steps) * 4294967296.0))
 
 #define FAULT_TOO_MANY_STEPS 1
 #define FAULT_SERVO_ALARM    2
+#define FAULT_WATCHDOG       3
+#define FAULT_STEP_COUNT     4
+#define FAULT_FOLLOWING      5
+
+#define CYCLE_OFF            0
+#define CYCLE_CUT            1
+#define CYCLE_AT_END         2
+#define CYCLE_RETURN         3
+#define CYCLE_AT_START       4
+#define CYCLE_ENGAGE         5
+
+#define HOLD_OFF             0
+#define HOLD_STOPPING        1
+#define HOLD_RESUMING        2
+
+#define CYCLE_REQUEST_NONE    0
+#define CYCLE_REQUEST_START   1
+#define CYCLE_REQUEST_ADVANCE 2
+#define CYCLE_REQUEST_EXIT    3
+
+#define MAX_STEPS_PER_TICK   255
+#define ENCODER_COUNTS       ((int32_t)ENCODER_PULSES)
+
+// Spindle speeds in 16.16 counts per ms that the timers can be left to
+// follow by themselves, the top one divided by the steps per A cycle.
+// Below the bottom one the encoder could turn back before it's noticed,
+// above the top one a train of steps at 9us each takes more than 80% of
+// the time between cycles.
+#define GEAR_MIN_SPEED       (1 << 16)
+#define GEAR_MAX_SPEED       (355 << 16)
+
+#define BACKLASH_STEPS ((uint32_t)(BACKLASH * DRIVE_RATIO * STEPPER_PULSES / LEADSCREW_PITCH))
 
 
-volatile static uint32_t steps_per_pulse = 0;
+volatile static ratio_t ratio = { 0, RATIO_FIXED_ONE };
 volatile static uint8_t reverse = 0;
 volatile static uint8_t fault = 0;
+volatile static int32_t carriage_position = 0;
+volatile static uint8_t stop_teach = FALSE;
+volatile static uint8_t pitch_reference_teach = FALSE;
+volatile static uint8_t stop_armed = FALSE;
+volatile static int32_t stop_position = 0;
+volatile static uint8_t cycle_state = CYCLE_OFF;
+volatile static uint8_t cycle_request = CYCLE_REQUEST_NONE;
+volatile static uint8_t jog_active = FALSE;
+volatile static int32_t jog_target = 0;
+volatile static uint8_t feed_active = FALSE;
+volatile static int32_t feed_speed = 0;
+volatile static uint8_t feed_hold = FALSE;
+volatile static uint32_t control_cycles_max = 0;
+volatile static uint64_t control_cycles_total = 0;
+volatile static uint32_t control_cycles_count = 0;
+volatile static uint32_t comp_cycles_max = 0;
+volatile static uint16_t gear_steps = 0;          // per A cycle if the ratio allows
+volatile static uint16_t gear_pulses = 0;         // per A cycle the timers are making
+volatile static int32_t feedback_error = 0;       // steps the motor is behind
+volatile static int32_t feedback_error_max = 0;
+volatile static int32_t feedback_settled = 0;     // steps out once stopped
+volatile static uint32_t spindle_count = 0;
+static uint32_t boot_time[BOOT_PHASES];   // us since reset
 
+// Machine parameters that can be changed from the console while running
+typedef struct
+{
+	uint32_t backlash;       // steps
+	uint32_t acceleration;   // mm/s/s
+	uint32_t rapid_speed;    // steps per tick, 16.16 fixed point
+	uint32_t jog_speed;      // steps per tick, 16.16 fixed point
+} params_t;
+
+volatile static params_t params = {
+	BACKLASH_STEPS, ACCELERATION, MOTION_SPEED(RAPID_SPEED), MOTION_SPEED(JOG_SPEED)
+};
+
+// A custom pitch set from the console, picked up by the panel
+static uint8_t custom_request = FALSE;
+static uint8_t custom_family = 0;
+static uint32_t custom_value = 0;    // thousandths of the family's unit
+static uint8_t custom_reverse = 0;
+static ratio_t custom_ratio;
+static int32_t custom_error = 0;
 
-void SysTick_Handler (void)
+// Decimal places shown for each pitch family
+static const uint8_t custom_decimals[RATIO_FAMILIES] = { 2, 1, 2, 0, 2 };
+static const uint16_t custom_scale[RATIO_FAMILIES] = { 10, 100, 10, 1000, 10 };
+
+
+RAMFUNC void SysTick_Handler (void)
 {
 	static uint32_t servo_current = 0x80000000;
 	static uint32_t encoder_current = 0x80000000;
-	static uint32_t last_steps_per_pulse = -1;
+	static ratio_t last_ratio = { -1, RATIO_FIXED_ONE };
 	static uint8_t last_reverse = 0;
 	static uint16_t last_encoder_pos = 0;
 	static int16_t last_encoder_diff = 0;
 	static volatile int32_t steps = 0;
+	static uint8_t last_direction = 0;
+	static uint32_t backlash_remaining = 0;
+	static int32_t pitch_comp_applied = 0;
+	static uint8_t stop_reverse = 0;
+	static int32_t cycle_start = 0;
+	static uint32_t cycle_encoder_ref = 0;
+	static uint32_t cycle_engage_pos = 0;
+	static motion_t cycle_motion;
+	static motion_t jog_motion;
+	static motion_t feed_motion;
+	static motion_t hold_motion;
+	static uint8_t hold_state = HOLD_OFF;
+	static int32_t last_steps = 0;
+	static uint16_t last_encoder_read = 0;
+	static int32_t last_encoder_fraction = 0;
+	static uint32_t spindle_angle = 0;
+	static uint8_t spindle_indexed = FALSE;
+	static uint32_t idle_ticks = 0;
+	static uint32_t servo_enable_wait = 0;
+	static int32_t motor_steps = 0;
+	static int32_t feedback_offset = 0;
+	static int32_t feedback_seen = 0;      // position the last full tick checked
+	static uint8_t feedback_synced = FALSE;
+	static uint32_t still_ticks = 0;
+	static int32_t gear_sign = 0;
+	static uint32_t gear_extra = 0;
+	static uint32_t gear_made = 0;
 
+	uint32_t start_cycles = get_cycles();
 	++ticks;
 
-	// Update a 32 bit encoder position from the 16 bit counter
+	// If the main loop has stopped checking in then stop the carriage
+	// and leave it to the watchdog to reset us
+	watchdog_checkin(WATCHDOG_CONTROL);
+	if(!watchdog_update() && fault != FAULT_WATCHDOG)
+	{
+		servo_stop();
+		servo_enable(FALSE);
+		fault = FAULT_WATCHDOG;
+	}
+
+	// The servo alarm is read every tick, idle or not, so that its
+	// debounce keeps time and it stops the carriage straight away
+	uint8_t alarm = servo_alarm_get();
+	if(alarm)
+		fault = FAULT_SERVO_ALARM;
+
+	// Once nothing has moved for a while only every few ticks run the
+	// whole control path, unless there is something new to do. The
+	// encoder timer carries on counting by itself, so as soon as it
+	// reads differently the full path runs and picks up every count.
+	// An alarm, or the motor being pushed off where it was, runs the
+	// full path too, for the fault checks and the black box.
 	uint16_t encoder_pos = spindle_encoder_get();
+	int32_t encoder_fraction = SPINDLE_INTERPOLATE ? spindle_encoder_interpolate(encoder_pos) : 0;
+	if(idle_ticks >= SPINDLE_IDLE_TIME && ticks % IDLE_TICK_INTERVAL != 0 && !alarm &&
+	   (FEEDBACK_PULSES == 0 || feedback_get() == feedback_seen) &&
+	   encoder_pos == last_encoder_read && encoder_fraction == last_encoder_fraction &&
+	   ratio.num == last_ratio.num && ratio.den == last_ratio.den && reverse == last_reverse &&
+	   (!jog_active || jog_target == carriage_position) && !feed_active &&
+	   cycle_request == CYCLE_REQUEST_NONE && !stop_teach && !pitch_reference_teach)
+	{
+		return;
+	}
+	last_encoder_read = encoder_pos;
+
+	// Steps are held back while a servo that was turned off wakes up
+	if(servo_enable_wait > 0)
+		--servo_enable_wait;
+	uint8_t servo_ready = servo_enable_wait == 0 && servo_is_idle();
+
+	// Update a 32 bit encoder position from the 16 bit counter
 	int16_t encoder_diff = (int16_t)(encoder_pos - last_encoder_pos);
 	// If direction is different to last then ignore small difference
 	// until it builds up, that way we filter out jitter from the encoder
-	if((encoder_diff ^ last_encoder_diff) < 0)
-		if(encoder_diff > -10 && encoder_diff < 10)
-			return;
-	last_encoder_diff = encoder_diff;
-	last_encoder_pos = encoder_pos;
+	if((encoder_diff ^ last_encoder_diff) < 0 &&
+	   encoder_diff > -10 && encoder_diff < 10)
+	{
+		encoder_diff = 0;
+	}
+	else
+	{
+		last_encoder_diff = encoder_diff;
+		last_encoder_pos = encoder_pos;
+	}
 	encoder_current += encoder_diff;
+	spindle_count += encoder_diff;
+
+	// Between counts the position is carried on from the rate they've
+	// been coming, so that at low speed the carriage moves smoothly
+	// rather than in jerks, but not while jitter is being ignored
+	if(encoder_pos != last_encoder_pos)
+		encoder_fraction = 0;
+	uint8_t fraction_moved = encoder_fraction != last_encoder_fraction;
+	last_encoder_fraction = encoder_fraction;
+
+	// Speed and acceleration from the encoder history, far finer than
+	// the difference from one tick to the next
+	int32_t spindle_velocity;
+	int32_t spindle_acceleration;
+	spindle_encoder_motion(&spindle_velocity, &spindle_acceleration);
+
+	// Keep track of the angle from the index pulse, to correct for the
+	// encoder's error within each turn and to learn what it is. Until the
+	// first index there's nothing to go on so no correction is made.
+	uint32_t comp_start = get_cycles();
+	uint16_t index_pos;
+	uint8_t index = spindle_encoder_index(&index_pos);
+	int32_t angle = index ? (int16_t)(last_encoder_pos - index_pos) : (int32_t)spindle_angle + encoder_diff;
+	angle %= ENCODER_COUNTS;
+	if(angle < 0)
+		angle += ENCODER_COUNTS;
+	spindle_angle = angle;
+	spindle_indexed |= index;
+	int64_t fine_angle = (int64_t)angle * 65536 + encoder_fraction;
+	if(fine_angle < 0)
+		fine_angle += (int64_t)ENCODER_COUNTS * 65536;
+	int32_t spindle_correction = 0;
+	if(spindle_indexed)
+	{
+		spindle_correction = spindle_comp_get(fine_angle);
+		spindle_comp_learn(ticks, fine_angle, spindle_velocity, index);
+	}
+	uint32_t comp_cycles = get_cycles() - comp_start;
+	if(comp_cycles > comp_cycles_max)
+		comp_cycles_max = comp_cycles;
 
 	// If the steps per pulse or direction has changed then reset the 
 	// counters so that the servo doesn't suddenly need to be in a 
@@ -84,47 +329,558 @@ void SysTick_Handler (void)
 	// we've either wrapped around from high to low, or we're going to
 	// wrap around from low to high imminently, either of which will
 	// cause a huge jump in servo position, so reset
-	if(steps_per_pulse != last_steps_per_pulse ||
+	if(ratio.num != last_ratio.num || ratio.den != last_ratio.den ||
 	   reverse != last_reverse || 
 	   encoder_current < 10000)
 	{
-		last_steps_per_pulse = steps_per_pulse;
+		last_ratio = ratio;
 		last_reverse = reverse;
+		gear_steps = HARDWARE_GEARING ? ratio_gear(last_ratio.num, last_ratio.den) : 0;
 		encoder_current = 0x80000000 + encoder_diff;
-		servo_current = FROM_FIXED_MULT(((uint64_t)0x80000000<<16) * last_steps_per_pulse);
+		servo_current = ratio_apply(0x80000000, last_ratio.num, last_ratio.den);
+		cycle_state = CYCLE_OFF;    // spindle phase reference is lost
+		hold_state = HOLD_OFF;
 	}
 
 
 	// Calculate the target servo position from the current encoder position
-	uint32_t servo_target = FROM_FIXED_MULT(((uint64_t)encoder_current<<16) * last_steps_per_pulse);
-	steps = (int32_t)(servo_target - servo_current);
-	uint32_t abs_steps = steps < 0 ? 0 - steps : steps;
+	int32_t fraction = encoder_fraction + spindle_correction;
+	uint32_t servo_target = ratio_apply_fraction(encoder_current + (fraction >> 16), fraction & 0xffff,
+	                                             last_ratio.num, last_ratio.den);
+
+	// Teaching a stop point makes it stop the carriage in whichever
+	// direction it was last moving
+	if(stop_teach)
+	{
+		stop_position = carriage_position;
+		stop_reverse = last_direction;
+		stop_armed = TRUE;
+		stop_teach = FALSE;
+	}
+
+	// The carriage is at the pitch error table's reference point. It's
+	// taken as being where the table says it is now, so nothing moves.
+	if(pitch_reference_teach)
+	{
+		pitch_comp_set_reference(carriage_position);
+		pitch_comp_applied = pitch_comp_get(carriage_position);
+		pitch_reference_teach = FALSE;
+	}
+
+	// Sign of the steps that move the carriage towards the stop point
+	int32_t stop_sign = (reverse ? -1 : 1) * (stop_reverse ? -1 : 1);
+
+	// Leaving the threading cycle, possibly part way through a return,
+	// means picking up synchronised motion from wherever the carriage is
+	if(cycle_state != CYCLE_OFF && (cycle_request == CYCLE_REQUEST_EXIT || !stop_armed))
+	{
+		cycle_state = CYCLE_OFF;
+		servo_current = servo_target;
+	}
+	if(cycle_request == CYCLE_REQUEST_ADVANCE)
+	{
+		if(cycle_state == CYCLE_AT_END)
+		{
+			motion_reset(&cycle_motion);
+			cycle_state = CYCLE_RETURN;
+		}
+		else if(cycle_state == CYCLE_AT_START)
+		{
+			// Wait for the spindle to next come round to the same angle
+			// that it was at when the carriage was here on the first pass
+			int32_t offset = (int32_t)(cycle_encoder_ref - encoder_current) * stop_sign % ENCODER_COUNTS;
+			if(offset < 0)
+				offset += ENCODER_COUNTS;
+			cycle_engage_pos = encoder_current + offset * stop_sign;
+			cycle_state = CYCLE_ENGAGE;
+		}
+	}
+	if(cycle_request != CYCLE_REQUEST_START)
+		cycle_request = CYCLE_REQUEST_NONE;
+
+	// Once the spindle reaches the engage angle carry on as if the carriage
+	// had been synchronised to it all along, so the next pass is in phase
+	if(cycle_state == CYCLE_ENGAGE &&
+	   (int32_t)(encoder_current - cycle_engage_pos) * stop_sign >= 0)
+	{
+		servo_current = ratio_apply(cycle_engage_pos, last_ratio.num, last_ratio.den);
+		cycle_state = CYCLE_CUT;
+	}
+
+	// Whole numbers of steps for each cycle of the encoder's A input can
+	// be left to the timers, TIM1 making a train of steps by itself each
+	// time TIM3 sees one, so the carriage follows the spindle within a
+	// microsecond. Here they're only counted, and the control loop takes
+	// back over as soon as there's anything else to do, the spindle is
+	// too slow or fast, or they've fallen behind.
+	int32_t spindle_sign = spindle_velocity < 0 ? -1 : 1;
+	uint32_t spindle_speed = spindle_velocity < 0 ? 0 - spindle_velocity : spindle_velocity;
+	uint8_t gear_direction = (spindle_sign * (reverse ? -1 : 1)) < 0;
+	uint8_t gear_ok = gear_steps > 0 && !fault && servo_is_enabled() && servo_enable_wait == 0 &&
+	                  cycle_state == CYCLE_OFF && !jog_active && !feed_active && feed_motion.speed == 0 &&
+	                  !feed_hold && hold_state == HOLD_OFF && !stop_armed && backlash_remaining == 0 &&
+	                  spindle_speed >= GEAR_MIN_SPEED && spindle_speed < GEAR_MAX_SPEED / gear_steps;
+	uint8_t geared = gear_pulses > 0;
+	int32_t gear_move = 0;
+	if(geared)
+	{
+		int32_t made = servo_gear_steps();
+		gear_made += made;
+		if(gear_made >= gear_pulses + gear_extra)
+			gear_extra = 0;     // the first train has caught up
+		made *= gear_sign;
+		gear_move = reverse ? 0 - made : made;
+		servo_current += made;
+		carriage_position += gear_move;
+		motor_steps += gear_move;
+		last_steps = made;
+		if(made != 0)
+			still_ticks = 0;
+
+		// Between cycles the spindle gets up to a cycle ahead
+		int32_t lag = (int32_t)(servo_target - servo_current) * gear_sign;
+		if(!gear_ok || gear_pulses != gear_steps || spindle_sign != gear_sign ||
+		   lag > 2 * gear_pulses + (int32_t)gear_extra || lag < -2 * (int32_t)gear_pulses)
+		{
+			servo_gear(0, 0);
+			gear_pulses = 0;
+		}
+	}
+	else if(gear_ok && servo_ready && gear_direction == last_direction)
+	{
+		// Whatever the carriage is behind is made up on the first cycle,
+		// as long as the train isn't then too long for the speed
+		int32_t lag = (int32_t)(servo_target - servo_current) * spindle_sign;
+		if(lag >= 0 && lag <= RATIO_GEAR_MAX - gear_steps &&
+		   spindle_speed < GEAR_MAX_SPEED / (gear_steps + lag))
+		{
+			servo_set_direction(gear_direction);
+			servo_gear(gear_steps, lag);
+			gear_pulses = gear_steps;
+			gear_sign = spindle_sign;
+			gear_extra = lag;
+			gear_made = 0;
+			geared = TRUE;
+		}
+	}
+	// Nothing else steps this tick, the timers might only just have stopped
+	if(geared)
+		servo_ready = FALSE;
+
+	// Carriage steps to make this tick, positive is forwards
+	int32_t move = 0;
+	if(cycle_state == CYCLE_RETURN || cycle_state == CYCLE_AT_START || cycle_state == CYCLE_ENGAGE)
+	{
+		// Not following the spindle, rapid back to the start if needed
+		steps = 0;
+		if(cycle_state == CYCLE_RETURN && servo_ready)
+			move = motion_update(&cycle_motion, cycle_start - carriage_position, params.rapid_speed);
+	}
+	else if(jog_active)
+	{
+		// Jogging doesn't follow the spindle at all, and the servo
+		// position is kept in step so there's no jump when it ends
+		steps = 0;
+		servo_current = servo_target;
+		if(servo_ready)
+		{
+			// Don't jog through an armed stop point
+			int32_t distance = jog_target - carriage_position;
+			if(stop_armed)
+			{
+				int32_t sign = stop_reverse ? -1 : 1;
+				int32_t room = (stop_position - carriage_position) * sign;
+				if(distance * sign > room)
+					distance = (room > 0 ? room : 0) * sign;
+			}
+			move = motion_update(&jog_motion, distance, params.jog_speed);
+		}
+	}
+	else if(feed_active || feed_motion.speed != 0)
+	{
+		// Feeding at a fixed rate is timed from this interrupt rather
+		// than the spindle, once it's stopped the carriage carries on
+		// following the spindle from where it ended up
+		steps = 0;
+		servo_current = servo_target;
+		if(servo_ready)
+		{
+			int32_t speed = feed_active ? feed_speed : 0;
+
+			// Slow down in time to stop on an armed stop point
+			int32_t sign = stop_reverse ? -1 : 1;
+			int32_t room = (stop_position - carriage_position) * sign;
+			if(room < 0)
+				room = 0;
+			if(stop_armed && speed * sign > 0)
+			{
+				uint32_t limit = motion_brake_limit(room);
+				if(limit < MAX_STEPS_PER_TICK && speed * sign > (int32_t)(limit << 16))
+					speed = (int32_t)(limit << 16) * sign;
+			}
+
+			move = motion_run(&feed_motion, speed);
+			if(stop_armed && move * sign > room)
+				move = room * sign;
+		}
+	}
+	else if(geared)
+	{
+		// The timers have made the steps
+		steps = 0;
+		move = gear_move;
+	}
+	else
+	{
+		motion_reset(&jog_motion);
+		int32_t lag = (int32_t)(servo_target - servo_current);
+		steps = lag;
+
+		// A feed hold brakes the carriage to a stop from the speed it was
+		// going, while the spindle carries on being tracked
+		if(feed_hold && hold_state == HOLD_OFF)
+		{
+			hold_motion.speed = (uint32_t)(last_steps < 0 ? 0 - last_steps : last_steps) << 16;
+			hold_motion.reverse = last_steps < 0;
+			hold_motion.fraction = 0;
+			hold_state = HOLD_STOPPING;
+		}
+		else if(!feed_hold && hold_state == HOLD_STOPPING)
+		{
+			hold_state = HOLD_RESUMING;
+		}
+
+		if(hold_state == HOLD_STOPPING)
+		{
+			steps = motion_run(&hold_motion, 0);
+		}
+		else if(hold_state == HOLD_RESUMING)
+		{
+			// Run faster than the spindle to catch up, easing off so as to
+			// arrive back in step with it rather than overshooting, then
+			// merge back in exactly in phase with where it would have been.
+			// Braking for twice the distance gives the speed ramp room to
+			// follow the curve, so the merge is smooth. The spindle's speed
+			// a tick ahead is fed forward in fractions of a step.
+			int64_t spindle_speed = (int64_t)(spindle_velocity + spindle_acceleration) *
+			                        last_ratio.num / last_ratio.den;
+			int32_t gap = lag - (int32_t)((spindle_speed + 32768) >> 16);
+			int32_t sign = gap < 0 ? -1 : 1;
+			int32_t catch_up = motion_brake_limit(gap * sign / 2);
+			int64_t speed = spindle_speed + (int64_t)catch_up * sign * 65536;
+			if(speed > MAX_STEPS_PER_TICK * 65536)
+				speed = MAX_STEPS_PER_TICK * 65536;
+			if(speed < -MAX_STEPS_PER_TICK * 65536)
+				speed = -MAX_STEPS_PER_TICK * 65536;
+			steps = motion_run(&hold_motion, (int32_t)speed);
+			if(gap == 0 || (steps - lag) * sign >= 0)
+			{
+				steps = lag;
+				hold_state = HOLD_OFF;
+			}
+		}
+
+		// Don't let the carriage run past the stop point, slowing down in
+		// time to halt exactly on it. The servo position is only advanced
+		// by the steps actually made, so the spindle is still tracked and
+		// the carriage moves off again in phase when it is reversed.
+		if(stop_armed)
+		{
+			int32_t towards = steps * stop_sign;
+			if(towards > 0)
+			{
+				int32_t distance = (stop_position - carriage_position) * (stop_reverse ? -1 : 1);
+				uint32_t limit = motion_brake_limit(distance > 0 ? distance : 0);
+				if((uint32_t)towards > limit)
+					steps = limit * stop_sign;
+			}
+		}
+
+		move = reverse ? 0 - steps : steps;
+	}
+	uint32_t abs_steps = move < 0 ? 0 - move : move;
+
+	// Idle when the spindle is stopped and there's nothing for the
+	// carriage to do, turning the servo off if configured to. Any
+	// reason to move turns it straight back on.
+	uint8_t busy = encoder_diff != 0 || fraction_moved || move != 0 || !servo_is_idle() ||
+	               servo_current != servo_target || backlash_remaining != 0 ||
+	               (jog_active && jog_target != carriage_position) || feed_active ||
+	               cycle_state == CYCLE_RETURN;
+	if(busy)
+	{
+		idle_ticks = 0;
+		if(!servo_is_enabled())
+		{
+			servo_enable(TRUE);
+			servo_enable_wait = SERVO_ENABLE_TIME;
+		}
+	}
+	else if(idle_ticks < SPINDLE_IDLE_TIME)
+	{
+		if(++idle_ticks == SPINDLE_IDLE_TIME && SERVO_IDLE_DISABLE)
+			servo_enable(FALSE);
+	}
 
 	// If too many steps for timer repeat register then we've fallen too far behind
-	if(abs_steps > 255)
+	if(abs_steps > MAX_STEPS_PER_TICK)
 		fault = FAULT_TOO_MANY_STEPS;
-	if(servo_alarm_get())
-		fault = FAULT_SERVO_ALARM;
+	// The carriage position assumes every step asked for was made, so
+	// check that against the pulses that actually came out
+	int32_t miscount = servo_audit();
+	if(miscount != 0 && STEP_AUDIT_FAULT)
+		fault = FAULT_STEP_COUNT;
+
+	// Compare where the motor has been told to go with where its driver
+	// says it is. Whenever it isn't being driven it could be anywhere, so
+	// it's taken to be where it should be once it's stopped.
+	if(FEEDBACK_PULSES > 0)
+	{
+		int32_t position = feedback_get();
+		feedback_seen = position;
+		if(servo_is_idle() && (!feedback_synced || fault || !servo_is_enabled() || servo_enable_wait > 0))
+		{
+			feedback_offset = motor_steps - position;
+			feedback_synced = TRUE;
+		}
+		int32_t error = motor_steps - position - feedback_offset;
+		int32_t abs_error = error < 0 ? 0 - error : error;
+		feedback_error = error;
+		if(abs_error > feedback_error_max)
+			feedback_error_max = abs_error;
+		if(still_ticks < FEEDBACK_SETTLE_TIME)
+			++still_ticks;
+		else
+			feedback_settled = error;
+		if(FEEDBACK_MAX_ERROR > 0 && abs_error > FEEDBACK_MAX_ERROR && !fault)
+			fault = FAULT_FOLLOWING;
+	}
 	if(!fault)
 	{
-		// If we have steps to make and the timer has finished sending
-		// the last train of pulses, then set the direction and step count
-		// and enable the pulse timer
-		if(steps != 0 && servo_is_idle())
+		// If the timer has finished sending the last train of pulses, then
+		// set the direction and step count and enable the pulse timer
+		if(servo_ready)
 		{
-			uint8_t reverse_direction = steps < 0;
-			if(reverse)
-				reverse_direction = !reverse_direction;
-			servo_set_direction(reverse_direction);
-			servo_step(abs_steps);
-			servo_current += steps;
+			// Correct for the leadscrew pitch error where the carriage is
+			// going to, using what's left of the step budget. Anything
+			// that doesn't fit is picked up on the next tick.
+			int32_t budget = MAX_STEPS_PER_TICK - abs_steps;
+			int32_t correction = pitch_comp_get(carriage_position + move) - pitch_comp_applied;
+			if(correction > budget)
+				correction = budget;
+			if(correction < -budget)
+				correction = -budget;
+			int32_t total = move + correction;
+			uint32_t abs_total = total < 0 ? 0 - total : total;
+
+			uint8_t direction = last_direction;
+			if(total != 0)
+				direction = total < 0;
+
+			// When the direction changes the slack in the leadscrew and
+			// half nut has to be taken up before the carriage moves again.
+			// If the previous take up hadn't finished then only the part
+			// that was already done needs to be undone.
+			if(direction != last_direction)
+			{
+				uint32_t backlash = params.backlash;
+				backlash_remaining = backlash_remaining < backlash ? backlash - backlash_remaining : 0;
+				last_direction = direction;
+			}
+
+			// Backlash steps use whatever is left of the step budget and
+			// aren't counted in the servo position, so they don't affect
+			// the phase of the carriage relative to the spindle
+			uint32_t backlash_steps = backlash_remaining;
+			if(backlash_steps > BACKLASH_RATE)
+				backlash_steps = BACKLASH_RATE;
+			if(backlash_steps > MAX_STEPS_PER_TICK - abs_total)
+				backlash_steps = MAX_STEPS_PER_TICK - abs_total;
+			backlash_remaining -= backlash_steps;
+
+			if(abs_total + backlash_steps > 0)
+			{
+				servo_set_direction(direction);
+				servo_step(abs_total + backlash_steps);
+				motor_steps += direction ? 0 - (int32_t)(abs_total + backlash_steps) : (int32_t)(abs_total + backlash_steps);
+				still_ticks = 0;
+				servo_current += steps;
+				last_steps = steps;
+				carriage_position += move;
+				pitch_comp_applied += correction;
+			}
+
+			// The first pass of a threading cycle starts from wherever the
+			// carriage is when the start point is taught, once it is
+			// exactly in step with the spindle
+			if(cycle_request == CYCLE_REQUEST_START)
+			{
+				if(!stop_armed || cycle_state != CYCLE_OFF)
+				{
+					cycle_request = CYCLE_REQUEST_NONE;
+				}
+				else if(servo_current == servo_target)
+				{
+					cycle_start = carriage_position;
+					cycle_encoder_ref = encoder_current;
+					cycle_state = CYCLE_CUT;
+					cycle_request = CYCLE_REQUEST_NONE;
+				}
+			}
 		}
+
+		if(cycle_state == CYCLE_CUT && carriage_position == stop_position)
+			cycle_state = CYCLE_AT_END;
+		if(cycle_state == CYCLE_RETURN && carriage_position == cycle_start)
+			cycle_state = CYCLE_AT_START;
 	} else {
 		servo_stop();
-		last_steps_per_pulse = 0;   // trigger reset when fault is cleared
+		last_ratio.num = 0;         // trigger reset when fault is cleared
+		cycle_request = CYCLE_REQUEST_NONE;
+	}
+
+
+	uint32_t cycles = get_cycles() - start_cycles;
+	if(cycles > control_cycles_max)
+		control_cycles_max = cycles;
+	control_cycles_total += cycles;
+	control_cycles_count += 1;
+
+	// Keep a record of the last few hundred ticks, which is frozen when
+	// a fault happens so that it can be read out afterwards
+	int32_t lag = (int32_t)(servo_target - servo_current);
+	blackbox_sample_t sample;
+	sample.encoder_diff = encoder_diff;
+	sample.steps = move;
+	if(lag > INT16_MAX)
+		lag = INT16_MAX;
+	if(lag < INT16_MIN)
+		lag = INT16_MIN;
+	sample.lag = lag;
+	sample.flags = (alarm ? BLACKBOX_FLAG_ALARM : 0) |
+	               (miscount != 0 ? BLACKBOX_FLAG_MISCOUNT : 0) |
+	               (servo_is_enabled() ? BLACKBOX_FLAG_ENABLED : 0) |
+	               (cycle_state << BLACKBOX_CYCLE_SHIFT) |
+	               (hold_state << BLACKBOX_HOLD_SHIFT);
+	sample.load = cycles >= (255 << 9) ? 255 : cycles >> 9;
+	blackbox_record(&sample);
+	if(fault)
+		blackbox_freeze(fault, ticks);
+
+	// and stream the same over the serial port for logging on a PC
+	telemetry_push(ticks, encoder_current, move, lag);
+}
+
+// Spindle speed and carriage speed, measured over a sliding window
+static int32_t spindle_rpm = 0;
+static int32_t carriage_speed = 0;   // steps per second
+
+void speed_update(uint32_t now)
+{
+	static uint32_t sampleTime[SPEED_SAMPLES];
+	static uint32_t sampleSpindle[SPEED_SAMPLES];
+	static int32_t sampleCarriage[SPEED_SAMPLES];
+	static uint8_t next = 0;
+	static uint8_t count = 0;
+
+	uint8_t last = (next + SPEED_SAMPLES - 1) % SPEED_SAMPLES;
+	if(count > 0 && now - sampleTime[last] < SPEED_SAMPLE_TIME)
+		return;
+
+	sampleTime[next] = now;
+	sampleSpindle[next] = spindle_count;
+	sampleCarriage[next] = carriage_position;
+	last = next;
+	next = (next + 1) % SPEED_SAMPLES;
+	if(count < SPEED_SAMPLES)
+		++count;
+
+	// Compare against the oldest sample still in the window
+	uint8_t first = count < SPEED_SAMPLES ? 0 : next;
+	uint32_t time = sampleTime[last] - sampleTime[first];
+	if(time == 0)
+		return;
+	int32_t counts = (int32_t)(sampleSpindle[last] - sampleSpindle[first]);
+	spindle_rpm = counts * 1000 / (int32_t)time * 60 / (int32_t)ENCODER_PULSES;
+	carriage_speed = (sampleCarriage[last] - sampleCarriage[first]) * 1000 / (int32_t)time;
+}
+
+// Fills in four digits, least significant first, with a signed number
+// that has the given number of decimal places, dropping decimal places
+// until it fits
+void format_number(int32_t value, uint8_t decimals, uint8_t* digits)
+{
+	uint8_t negative = value < 0;
+	uint32_t magnitude = negative ? 0 - value : value;
+	uint32_t limit = negative ? 1000 : 10000;
+
+	while(magnitude >= limit && decimals > 0)
+	{
+		magnitude /= 10;
+		--decimals;
+	}
+	if(magnitude >= limit)
+	{
+		digits[0] = digits[1] = digits[2] = digits[3] = MINUS;
+		return;
+	}
+
+	for(uint8_t i = 0; i < 4; ++i)
+	{
+		if(magnitude == 0 && i > decimals)
+		{
+			digits[i] = negative ? MINUS : BLANK;
+			negative = FALSE;
+		}
+		else
+		{
+			digits[i] = magnitude % 10;
+			magnitude /= 10;
+		}
+		if(i == decimals && decimals > 0)
+			digits[i] |= POINT;
+	}
+}
+
+// A custom pitch is dialled in as three digits, numbered from the left
+uint16_t custom_power(uint8_t digit)
+{
+	return digit == 0 ? 100 : digit == 1 ? 10 : 1;
+}
+
+uint8_t custom_digit(uint16_t value, uint8_t digit)
+{
+	return value / custom_power(digit) % 10;
+}
+
+uint16_t custom_display(uint8_t family, uint32_t value)
+{
+	value /= custom_scale[family];
+	return value > 999 ? 999 : value;
+}
+
+const table_t* get_table(uint8_t units)
+{
+	return &tables[units < TABLES ? units : TABLES - 1];
+}
+
+// The tables hold the value shown as a number, to save space
+void table_digits(const table_t* table, uint8_t index, uint8_t* digits)
+{
+	format_number(table->entries[index].value, table->decimals, digits);
+	for(uint8_t i = 1; i < 3 && table->zero; ++i)
+	{
+		if(digits[i] == BLANK)
+			digits[i] = 0;
 	}
 }
 
+ratio_t table_ratio(const table_t* table, uint8_t index)
+{
+	ratio_t result = { table->entries[index].num, table->entries[index].den };
+	return result;
+}
+
 void ui_update()
 {
 	static uint8_t uiState = UI_STATE_IDLE;
@@ -135,23 +891,95 @@ void ui_update()
 	static int16_t changeValue = 0;
 	static uint8_t changeReverse = 0;
 	static uint32_t lastChangeTime = 0;
+	static int16_t lastKnob = 0;
+	static uint8_t feedRunning = FALSE;
+	static uint8_t displayPage = PAGE_SETTING;
+	static uint32_t pageChangeTime = 0;
+	static uint8_t customFamily = RATIO_FAMILY_MM;
+	static uint32_t customValue = 1000;
+	static ratio_t customRatio = { 0, 0 };
+	static int32_t customError = 0;
+	static uint32_t customErrorTime = 0;
+	static uint8_t customStage = CUSTOM_STAGE_FAMILY;
+	static uint8_t changeFamily = 0;
+	static uint16_t changeCustom = 0;
 
 	if(fault)
 	{
 		uiState = UI_STATE_FAULT;
 	}
 
+	uint8_t wasIdle = uiState == UI_STATE_IDLE;
 	uint32_t now = get_ticks();
+
+	if(customRatio.den == 0)
+		customError = ratio_for_pitch(customFamily, customValue, &customRatio);
+	if(custom_request && uiState == UI_STATE_IDLE)
+	{
+		activeUnits = UNITS_CUSTOM;
+		activeReverse = custom_reverse;
+		customFamily = custom_family;
+		customValue = custom_value;
+		customRatio = custom_ratio;
+		customError = custom_error;
+		customErrorTime = now;
+		feed_hold = FALSE;
+		custom_request = FALSE;
+	}
+
 	uint8_t buttonClicks = input_button_get();
+	if(buttonClicks == BUTTON_LONG_PRESS)
+	{
+		// long press to start and stop feeding at a fixed rate, or to
+		// hold and resume a feed that's following the spindle
+		if(uiState == UI_STATE_IDLE && activeUnits == UNITS_FEED_RATE)
+			feedRunning = !feedRunning;
+		else if(uiState == UI_STATE_IDLE && UNITS_FOLLOW_SPINDLE(activeUnits))
+			feed_hold = !feed_hold;
+		buttonClicks = 0;
+	}
 	if(buttonClicks > 0)
 	{
 		if(uiState == UI_STATE_IDLE)
 		{
-			if(buttonClicks > 1)
+			if(buttonClicks == 3)
+			{
+				// triple-click to teach the stop point, then to teach the
+				// start point of a threading cycle, then to clear them both.
+				// Clicking at the stop point clears it without a cycle.
+				if(cycle_state != CYCLE_OFF)
+				{
+					cycle_request = CYCLE_REQUEST_EXIT;
+					stop_armed = FALSE;
+				}
+				else if(!stop_armed)
+					stop_teach = TRUE;
+				else if(carriage_position == stop_position || !UNITS_FOLLOW_SPINDLE(activeUnits))
+					stop_armed = FALSE;
+				else
+					cycle_request = CYCLE_REQUEST_START;
+			}
+			else if(cycle_state != CYCLE_OFF)
+			{
+				// single-click to return to the start or begin the next
+				// pass, the table can't be changed until the cycle ends
+				if(buttonClicks == 1)
+					cycle_request = CYCLE_REQUEST_ADVANCE;
+			}
+			else if(buttonClicks > 1)
 			{
 				input_encoder_set(activeUnits);
 				uiState = UI_STATE_CHANGE_UNITS;
 			}
+			else if(activeUnits == UNITS_CUSTOM)
+			{
+				customStage = CUSTOM_STAGE_FAMILY;
+				changeFamily = customFamily;
+				changeCustom = custom_display(customFamily, customValue);
+				changeReverse = activeReverse;
+				input_encoder_set(activeReverse ? 0 - customFamily - 1 : customFamily);
+				uiState = UI_STATE_CHANGE_VALUE;
+			}
 			else
 			{
 				if(activeReverse) {
@@ -167,13 +995,56 @@ void ui_update()
 			if(uiState == UI_STATE_CHANGE_UNITS)
 			{
 				activeUnits = changeUnits;
-				input_encoder_set(activeValue);
+				feed_hold = FALSE;
+				if(activeUnits == UNITS_CUSTOM)
+				{
+					customStage = CUSTOM_STAGE_FAMILY;
+					changeFamily = customFamily;
+					changeCustom = custom_display(customFamily, customValue);
+					changeReverse = activeReverse;
+					input_encoder_set(activeReverse ? 0 - customFamily - 1 : customFamily);
+				}
+				else
+					input_encoder_set(activeValue);
 				uiState = UI_STATE_CHANGE_VALUE;
 			}
+			else if(uiState == UI_STATE_CHANGE_VALUE && activeUnits == UNITS_CUSTOM)
+			{
+				// click through the family then each digit, and once the
+				// last one is in work out the ratio for it
+				if(customStage < CUSTOM_STAGE_DIGIT + CUSTOM_DIGITS - 1)
+				{
+					++customStage;
+					input_encoder_set(custom_digit(changeCustom, customStage - CUSTOM_STAGE_DIGIT));
+				}
+				else
+				{
+					ratio_t newRatio;
+					uint32_t newValue = changeCustom * custom_scale[changeFamily];
+					int32_t error = ratio_for_pitch(changeFamily, newValue, &newRatio);
+					if(error == RATIO_INVALID)
+					{
+						customStage = CUSTOM_STAGE_DIGIT;
+						input_encoder_set(custom_digit(changeCustom, 0));
+					}
+					else
+					{
+						customFamily = changeFamily;
+						customValue = newValue;
+						customRatio = newRatio;
+						customError = error;
+						customErrorTime = now;
+						activeReverse = changeReverse;
+						feed_hold = FALSE;
+						uiState = UI_STATE_IDLE;
+					}
+				}
+			}
 			else if(uiState == UI_STATE_CHANGE_VALUE)
 			{
 				activeValue = changeValue;
 				activeReverse = changeReverse;
+				feed_hold = FALSE;
 				uiState = UI_STATE_IDLE;
 			}
 			else if(uiState == UI_STATE_FAULT)
@@ -209,30 +1080,44 @@ void ui_update()
 		displayUnits = changeUnits;
 	}
 
-	table_entry_t* table;
-	uint8_t tableSize;
-	if(displayUnits == 0)
-	{
-		table = table_mm_feed;
-		tableSize = sizeof(table_mm_feed) / sizeof(*table_mm_feed);
-	}
-	else if(displayUnits == 1)
-	{
-		table = table_mm_thread;
-		tableSize = sizeof(table_mm_thread) / sizeof(*table_mm_thread);
-	}
-	else if(displayUnits == 2)
-	{
-		table = table_inch_feed;
-		tableSize = sizeof(table_inch_feed) / sizeof(*table_inch_feed);
-	}
-	else if(displayUnits == 3)
+	const table_t* table = get_table(displayUnits);
+	uint8_t tableSize = table->size;
+
+	if(uiState == UI_STATE_CHANGE_VALUE && activeUnits == UNITS_CUSTOM)
 	{
-		table = table_inch_thread;
-		tableSize = sizeof(table_inch_thread) / sizeof(*table_inch_thread);
+		int16_t newValue = input_encoder_get();
+		if(customStage == CUSTOM_STAGE_FAMILY)
+		{
+			// same as the tables, turning back past the first is reverse
+			uint8_t newReverse = newValue < 0;
+			uint8_t family = newReverse ? 0 - newValue - 1 : newValue;
+			if(family >= RATIO_FAMILIES)
+			{
+				family = RATIO_FAMILIES - 1;
+				input_encoder_set(newReverse ? 0 - family - 1 : family);
+			}
+			if(family != changeFamily || newReverse != changeReverse)
+				lastChangeTime = now;
+			changeFamily = family;
+			changeReverse = newReverse;
+		}
+		else
+		{
+			uint8_t digit = customStage - CUSTOM_STAGE_DIGIT;
+			if(newValue < 0 || newValue > 9)
+			{
+				newValue = newValue < 0 ? 0 : 9;
+				input_encoder_set(newValue);
+			}
+			uint8_t oldDigit = custom_digit(changeCustom, digit);
+			if(newValue != oldDigit)
+			{
+				lastChangeTime = now;
+				changeCustom += (newValue - oldDigit) * custom_power(digit);
+			}
+		}
 	}
-
-	if(uiState == UI_STATE_CHANGE_VALUE)
+	else if(uiState == UI_STATE_CHANGE_VALUE)
 	{
 		int16_t newValue = input_encoder_get();
 		if(newValue != changeValue)
@@ -265,6 +1150,26 @@ void ui_update()
 	if(now - lastChangeTime > CHANGE_TIMEOUT && uiState != UI_STATE_FAULT)
 		uiState = UI_STATE_IDLE;
 
+	// The units can be changed without going on to pick a value, so make
+	// sure the value is still inside the table
+	const table_t* activeTable = get_table(activeUnits);
+	uint8_t activeSize = activeTable->size;
+	if(activeValue >= activeSize)
+		activeValue = activeSize - 1;
+	uint8_t displayValue = activeValue < tableSize ? activeValue : tableSize - 1;
+
+	// Outside of jog mode turning the knob flips between showing the
+	// setting, spindle speed, carriage position and carriage feed rate
+	int16_t knob = input_encoder_get();
+	int16_t knobMoved = knob - lastKnob;
+	lastKnob = knob;
+	if(wasIdle && uiState == UI_STATE_IDLE && activeUnits != UNITS_JOG && knobMoved != 0)
+	{
+		displayPage = (displayPage + PAGE_COUNT + (knobMoved > 0 ? 1 : -1)) % PAGE_COUNT;
+		pageChangeTime = now;
+	}
+	speed_update(now);
+
 	
 	uint8_t leds;
 	uint8_t digit1;
@@ -281,18 +1186,62 @@ void ui_update()
 			digit100 = ERROR;
 			digit1000 = MINUS;
 		}
+		else if(fault == FAULT_WATCHDOG)
+		{
+			// how many times the watchdog has gone off since power up
+			uint8_t digits[4];
+			format_number(watchdog_reset_count(), 0, digits);
+			digit1 = digits[0];
+			digit10 = digits[1];
+			digit100 = digits[2];
+			digit1000 = digits[3];
+		}
 		else
 		{
 			digit1 = digit10 = digit100 = digit1000 = BLANK;
 		}
 	}
+	else if(uiState == UI_STATE_CHANGE_VALUE && activeUnits == UNITS_CUSTOM)
+	{
+		if(customStage == CUSTOM_STAGE_FAMILY)
+		{
+			// -n- for the pitch family
+			if(!flashBlank)
+			{
+				digit1 = MINUS;
+				digit10 = changeFamily + 1;
+				digit100 = MINUS;
+			}
+			else
+				digit1 = digit10 = digit100 = BLANK;
+		}
+		else
+		{
+			// just the digit being changed flashes
+			uint8_t digits[CUSTOM_DIGITS];
+			for(uint8_t i = 0; i < CUSTOM_DIGITS; ++i)
+			{
+				digits[i] = custom_digit(changeCustom, i);
+				if(CUSTOM_DIGITS - 1 - i == custom_decimals[changeFamily] && i != CUSTOM_DIGITS - 1)
+					digits[i] |= POINT;
+				if(flashBlank && i == customStage - CUSTOM_STAGE_DIGIT)
+					digits[i] = BLANK;
+			}
+			digit100 = digits[0];
+			digit10 = digits[1];
+			digit1 = digits[2];
+		}
+		digit1000 = changeReverse ? MINUS : BLANK;
+	}
 	else if(uiState == UI_STATE_CHANGE_VALUE)
 	{
 		if(!flashBlank)
 		{
-			digit1 = table[changeValue].dig1;
-			digit10 = table[changeValue].dig10;
-			digit100 = table[changeValue].dig100;
+			uint8_t digits[4];
+			table_digits(table, changeValue, digits);
+			digit1 = digits[0];
+			digit10 = digits[1];
+			digit100 = digits[2];
 			if(changeReverse)
 				digit1000 = MINUS;
 			else
@@ -301,15 +1250,90 @@ void ui_update()
 		else
 			digit1 = digit10 = digit100 = digit1000 = BLANK;
 	}
+	else if(uiState == UI_STATE_IDLE && displayPage != PAGE_SETTING)
+	{
+		uint8_t digits[4];
+		if(now - pageChangeTime < PAGE_NAME_TIME)
+		{
+			digits[0] = displayPage;
+			digits[1] = digits[2] = BLANK;
+			digits[3] = PAGE;
+		}
+		else if(displayPage == PAGE_RPM)
+		{
+			format_number(spindle_rpm, 0, digits);
+		}
+		else
+		{
+			// Distances are in hundredths of a mm or thousandths of an
+			// inch, through whichever screw the current units drive
+			uint8_t units = activeUnits;
+			if(units == UNITS_CUSTOM)
+				units = customFamily == RATIO_FAMILY_FEED ? 0 :
+				        customFamily == RATIO_FAMILY_TPI || customFamily == RATIO_FAMILY_DP ? 3 : 1;
+			int64_t scale;
+			if(UNITS_INCH(units))
+				scale = UNITS_FEEDSCREW(units) ? SCALE_INCH(STEPS_PER_MM_FEED) : SCALE_INCH(STEPS_PER_MM_THREAD);
+			else
+				scale = UNITS_FEEDSCREW(units) ? SCALE_MM(STEPS_PER_MM_FEED) : SCALE_MM(STEPS_PER_MM_THREAD);
+			uint8_t decimals = UNITS_INCH(units) ? 3 : 2;
+			if(displayPage == PAGE_POSITION)
+			{
+				format_number((carriage_position * scale) >> 32, decimals, digits);
+			}
+			else
+			{
+				// per minute, one decimal place fewer
+				format_number((carriage_speed * 6 * scale) >> 32, decimals - 1, digits);
+			}
+		}
+		digit1 = digits[0];
+		digit10 = digits[1];
+		digit100 = digits[2];
+		digit1000 = digits[3];
+	}
 	else
 	{
-		digit1 = table[activeValue].dig1;
-		digit10 = table[activeValue].dig10;
-		digit100 = table[activeValue].dig100;
-		if(activeReverse)
+		if(displayUnits == UNITS_CUSTOM)
+		{
+			// After a new custom pitch the error in the ratio is shown
+			// for a moment, in parts per billion
+			uint8_t digits[4];
+			if(uiState == UI_STATE_IDLE && now - customErrorTime < CUSTOM_ERROR_TIME)
+			{
+				int32_t error = customError < 0 ? 0 - customError : customError;
+				format_number(error > 999 ? 999 : error, 0, digits);
+			}
+			else
+			{
+				format_number(custom_display(customFamily, customValue), custom_decimals[customFamily], digits);
+			}
+			digit1 = digits[0];
+			digit10 = digits[1];
+			digit100 = digits[2];
+		}
+		else
+		{
+			uint8_t digits[4];
+			table_digits(table, displayValue, digits);
+			digit1 = digits[0];
+			digit10 = digits[1];
+			digit100 = digits[2];
+		}
+		if(displayUnits == UNITS_CUSTOM && uiState == UI_STATE_IDLE && now - customErrorTime < CUSTOM_ERROR_TIME)
+			digit1000 = ERROR;
+		else if(feed_hold)
+			digit1000 = HOLD;
+		else if(activeReverse)
 			digit1000 = MINUS;
 		else
 			digit1000 = BLANK;
+		// flash the stop point indicator when the cycle needs a click
+		uint8_t cycleWaiting = cycle_state == CYCLE_AT_END || cycle_state == CYCLE_AT_START;
+		if(stop_armed && !(cycleWaiting && flashBlank))
+			digit1000 |= POINT;
+		if(feedRunning)
+			digit1 |= POINT;
 	}
 
 	if(uiState == UI_STATE_CHANGE_UNITS)
@@ -317,10 +1341,10 @@ void ui_update()
 		if(flashBlank)
 			leds = 0;
 		else
-			leds = 1 << (changeUnits + 1);
+			leds = UNITS_LEDS(changeUnits);
 	}
 	else
-		leds = 1 << (activeUnits + 1);
+		leds = UNITS_LEDS(activeUnits);
 
 	display_write(MAX7219_DIGIT0, digit1);
 	display_write(MAX7219_DIGIT1, digit10);
@@ -328,20 +1352,425 @@ void ui_update()
 	display_write(MAX7219_DIGIT3, digit1000);
 	display_write(MAX7219_DIGIT4, leds);
 
-	steps_per_pulse = table[activeValue].steps_per_pulse;
+	// In jog mode the carriage doesn't follow the spindle and each detent
+	// of the knob moves it on by the selected distance instead
+	if(activeUnits == UNITS_JOG)
+	{
+		ratio_t step = table_ratio(activeTable, activeValue);
+		int32_t jog = knobMoved * (int32_t)ratio_apply(1, step.num, step.den);
+		if(activeReverse)
+			jog = 0 - jog;
+
+		__disable_irq();
+		if(!jog_active)
+		{
+			jog_target = carriage_position;
+			jog_active = TRUE;
+		}
+		if(wasIdle && uiState == UI_STATE_IDLE)
+			jog_target += jog;
+		__enable_irq();
+	}
+	else
+	{
+		jog_active = FALSE;
+	}
+
+	// For a fixed feed rate the table gives the speed instead of a ratio
+	if(activeUnits == UNITS_FEED_RATE)
+	{
+		ratio_t rate = table_ratio(activeTable, activeValue);
+		int32_t speed = ((uint64_t)rate.num * RATIO_FIXED_ONE + rate.den / 2) / rate.den;
+		feed_speed = feedRunning ? (activeReverse ? 0 - speed : speed) : 0;
+		feed_active = TRUE;
+	}
+	else
+	{
+		feedRunning = FALSE;
+		feed_active = FALSE;
+	}
+
+	ratio_t newRatio = { 0, RATIO_FIXED_ONE };
+	if(activeUnits == UNITS_CUSTOM)
+		newRatio = customRatio;
+	else if(UNITS_FOLLOW_SPINDLE(activeUnits))
+		newRatio = table_ratio(activeTable, activeValue);
+	__disable_irq();
+	ratio = newRatio;
 	reverse = activeReverse;
+	__enable_irq();
+}
+
+
+uint8_t console_family(const char* command)
+{
+	if(console_match(command, "pitch"))
+		return RATIO_FAMILY_MM;
+	if(console_match(command, "tpi"))
+		return RATIO_FAMILY_TPI;
+	if(console_match(command, "module"))
+		return RATIO_FAMILY_MODULE;
+	if(console_match(command, "dp"))
+		return RATIO_FAMILY_DP;
+	if(console_match(command, "feed"))
+		return RATIO_FAMILY_FEED;
+	return RATIO_FAMILIES;
+}
+
+void console_params()
+{
+	params_t current = params;
+	console_write("backlash ");
+	console_write_number((uint64_t)current.backlash * 1000 / (uint32_t)STEPS_PER_MM_THREAD, 3);
+	console_write(" accel ");
+	console_write_number(current.acceleration, 0);
+	console_write(" rapid ");
+	console_write_number((uint64_t)current.rapid_speed * 1000 / MOTION_SPEED(1.0), 3);
+	console_write(" jog ");
+	console_write_number((uint64_t)current.jog_speed * 1000 / MOTION_SPEED(1.0), 3);
+	console_end_line();
+}
+
+// A speed in thousandths of a mm/s as steps per tick, held to what TIM1
+// can step and saying so if it had to be
+uint32_t console_speed(int32_t value)
+{
+	uint64_t speed = (uint64_t)value * MOTION_SPEED(1.0) / 1000;
+	if(speed <= (uint32_t)STEP_RATE_MAX << 16)
+		return speed;
+
+	console_write("clamped to ");
+	console_write_number(((uint64_t)STEP_RATE_MAX << 16) * 1000 / MOTION_SPEED(1.0), 3);
+	console_write(", ");
+	console_write_number(STEP_RATE_MAX, 0);
+	console_write(" steps per ms");
+	console_end_line();
+	return (uint32_t)STEP_RATE_MAX << 16;
+}
+
+void console_blackbox()
+{
+	console_write("fault ");
+	console_write_number(blackbox_fault(), 0);
+	console_write(" tick ");
+	console_write_unsigned(blackbox_ticks(), 0);
+	console_end_line();
+	if(!blackbox_fault())
+		return;
+
+	console_line("age encoder steps lag flags load");
+	for(uint16_t age = 0; age < BLACKBOX_SAMPLES; ++age)
+	{
+		const blackbox_sample_t* sample = blackbox_get(age);
+		console_write_number(age, 0);
+		console_write(" ");
+		console_write_number(sample->encoder_diff, 0);
+		console_write(" ");
+		console_write_number(sample->steps, 0);
+		console_write(" ");
+		console_write_number(sample->lag, 0);
+		console_write(" ");
+		console_write_number(sample->flags, 0);
+		console_write(" ");
+		console_write_number(sample->load, 0);
+		console_end_line();
+	}
+}
+
+// Handles one line from the serial console. This runs from the main
+// loop, anything the control loop uses is changed in one go with
+// interrupts disabled.
+void console_command(char* line)
+{
+	char* command = console_next_word(&line);
+	char* arg1 = console_next_word(&line);
+	char* arg2 = console_next_word(&line);
+	int32_t value;
+
+	if(console_match(command, "status"))
+	{
+		console_write("ratio ");
+		console_write_unsigned(ratio.num, 0);
+		console_write("/");
+		console_write_unsigned(ratio.den, 0);
+		console_write(reverse ? " reverse" : " forward");
+		console_write(" position ");
+		console_write_number(carriage_position, 0);
+		console_write(" rpm ");
+		console_write_number(spindle_rpm, 0);
+		console_write(" fault ");
+		console_write_number(fault, 0);
+		console_end_line();
+		console_write("gear ");
+		console_write_number(gear_steps, 0);
+		console_write(gear_pulses > 0 ? " on" : " off");
+		console_end_line();
+		console_write("stop ");
+		console_write_number(stop_armed ? stop_position : 0, 0);
+		console_write(stop_armed ? " armed" : " off");
+		console_write(" cycle ");
+		console_write_number(cycle_state, 0);
+		console_write(" hold ");
+		console_write_number(feed_hold, 0);
+		console_end_line();
+	}
+	else if(console_family(command) < RATIO_FAMILIES)
+	{
+		// any pitch, in thousandths of the family's unit, negative for
+		// reverse, worked out here and picked up by the panel
+		uint8_t family = console_family(command);
+		if(!console_parse_number(arg1, 3, &value))
+		{
+			console_line("error: bad number");
+			return;
+		}
+		ratio_t newRatio = { 0, 0 };
+		int32_t error = ratio_for_pitch(family, value < 0 ? 0 - value : value, &newRatio);
+		if(error == RATIO_INVALID && newRatio.den != 0 && ratio_max_rpm(newRatio.num, newRatio.den) < PITCH_MIN_RPM)
+		{
+			console_write("error: pitch too coarse, ");
+			console_write_unsigned(ratio_max_rpm(newRatio.num, newRatio.den), 0);
+			console_write(" rpm max");
+			console_end_line();
+			return;
+		}
+		if(error == RATIO_INVALID)
+		{
+			console_line("error: pitch out of range");
+			return;
+		}
+		custom_family = family;
+		custom_value = value < 0 ? 0 - value : value;
+		custom_reverse = value < 0;
+		custom_ratio = newRatio;
+		custom_error = error;
+		custom_request = TRUE;
+		console_write("ok ");
+		console_write_unsigned(newRatio.num, 0);
+		console_write("/");
+		console_write_unsigned(newRatio.den, 0);
+		console_write(" error ");
+		console_write_number(error, 0);
+		console_write(" ppb, ");
+		console_write_unsigned(ratio_max_rpm(newRatio.num, newRatio.den), 0);
+		console_write(" rpm max");
+		console_end_line();
+	}
+	else if(console_match(command, "params"))
+	{
+		console_params();
+	}
+	else if(console_match(command, "set"))
+	{
+		params_t changed = params;
+		if(!console_match(arg1, "backlash") && !console_match(arg1, "accel") &&
+		   !console_match(arg1, "rapid") && !console_match(arg1, "jog"))
+		{
+			console_line("error: bad parameter");
+			return;
+		}
+		if(!console_parse_number(arg2, 3, &value))
+		{
+			console_line("error: bad number");
+			return;
+		}
+		if(console_match(arg1, "backlash") && value >= 0)
+			changed.backlash = (uint64_t)value * (uint32_t)STEPS_PER_MM_THREAD / 1000;
+		else if(console_match(arg1, "accel") && value >= 1000)
+			changed.acceleration = value / 1000;
+		else if(console_match(arg1, "rapid") && value > 0)
+			changed.rapid_speed = console_speed(value);
+		else if(console_match(arg1, "jog") && value > 0)
+			changed.jog_speed = console_speed(value);
+		else
+		{
+			console_line("error: value out of range");
+			return;
+		}
+		uint32_t accel = (uint64_t)changed.acceleration * MOTION_ACCEL(1000.0) / 1000;
+
+		__disable_irq();
+		params = changed;
+		motion_set_acceleration(accel);
+		__enable_irq();
+		console_params();
+	}
+	else if(console_match(command, "telemetry"))
+	{
+		if(!console_match(arg1, "on") && !console_match(arg1, "off"))
+		{
+			console_line("error: on or off");
+			return;
+		}
+		telemetry_enable(console_match(arg1, "on"));
+		console_line("ok");
+	}
+	else if(console_match(command, "blackbox"))
+	{
+		if(console_match(arg1, "clear"))
+		{
+			__disable_irq();
+			blackbox_release();
+			__enable_irq();
+			console_line("ok");
+		}
+		else
+			console_blackbox();
+	}
+	else if(console_match(command, "diag"))
+	{
+		// compare the fast build against the normal one here
+		__disable_irq();
+		uint64_t total = control_cycles_total;
+		uint32_t count = control_cycles_count;
+		control_cycles_total = 0;
+		control_cycles_count = 0;
+		__enable_irq();
+		console_write("cycles max ");
+		console_write_unsigned(control_cycles_max, 0);
+		console_write(" mean ");
+		console_write_unsigned(count > 0 ? total / count : 0, 0);
+#ifdef FAST_PROFILE
+		console_write(" profile fast");
+#else
+		console_write(" profile size");
+#endif
+		console_write(" comp max ");
+		console_write_unsigned(comp_cycles_max, 0);
+		console_write(" reset cause ");
+		console_write_number(watchdog_reset_cause(), 0);
+		console_write(" watchdog resets ");
+		console_write_unsigned(watchdog_reset_count(), 0);
+		console_end_line();
+		servo_audit_t audit;
+		__disable_irq();
+		servo_audit_get(&audit);
+		__enable_irq();
+		console_write("steps lost ");
+		console_write_unsigned(audit.lost, 0);
+		console_write(" extra ");
+		console_write_unsigned(audit.extra, 0);
+		console_write(" mismatches ");
+		console_write_unsigned(audit.mismatches, 0);
+		console_write(" reversals ");
+		console_write_unsigned(audit.reversals, 0);
+		console_end_line();
+		if(FEEDBACK_PULSES > 0)
+		{
+			console_write("feedback error ");
+			console_write_number(feedback_error, 0);
+			console_write(" max ");
+			console_write_number(feedback_error_max, 0);
+			console_write(" settled ");
+			console_write_number(feedback_settled, 0);
+			console_write(" missed ");
+			console_write_unsigned(feedback_missed(), 0);
+			console_end_line();
+			feedback_error_max = 0;
+		}
+		if(SPINDLE_ANALOG)
+		{
+			console_write("analog cycles per sample ");
+			console_write_unsigned(spindle_encoder_cycles(), 0);
+			console_end_line();
+		}
+		control_cycles_max = 0;
+		comp_cycles_max = 0;
+	}
+	else if(console_match(command, "boot"))
+	{
+		// the spindle is being followed from the first tick after control,
+		// and the panel is up at ready
+		static const char* const phases[BOOT_PHASES] = { "clock ", " control ", " display ", " ready " };
+		static const char* const sources[] = { "hse", "hsi", "hsi no pll" };
+		for(uint8_t i = 0; i < BOOT_PHASES; ++i)
+		{
+			console_write(phases[i]);
+			console_write_number(boot_time[i] / 10, 2);
+		}
+		console_write(" ms, clock ");
+		console_write(sources[clock_get_source()]);
+		console_end_line();
+	}
+	else if(console_match(command, "spincomp"))
+	{
+		// learn the spindle encoder's error over a number of turns, or
+		// show the table to paste into config.h
+		if(console_match(arg1, "learn"))
+		{
+			if(!console_parse_number(arg2, 0, &value))
+			{
+				console_line("error: bad number");
+				return;
+			}
+			if(value < 0 || value > UINT16_MAX)
+			{
+				console_line("error: turns out of range");
+				return;
+			}
+			spindle_comp_start(value);
+			console_line("ok");
+			return;
+		}
+		console_write("turns to go ");
+		console_write_number(spindle_comp_update(), 0);
+		console_end_line();
+		console_line("#define SPINDLE_COMP_ERRORS { \\");
+		for(uint8_t i = 0; i < SPINDLE_COMP_BINS; ++i)
+		{
+			console_write(i % 8 == 0 ? "\t" : " ");
+			console_write_number(spindle_comp_error(i), 0);
+			console_write(",");
+			if(i % 8 == 7 || i == SPINDLE_COMP_BINS - 1)
+			{
+				console_write(" \\");
+				console_end_line();
+			}
+		}
+		console_line("}");
+	}
+	else if(console_match(command, "pitchref"))
+	{
+		// the carriage is at the reference point of the pitch error table
+		pitch_reference_teach = TRUE;
+		console_line("ok");
+	}
+	else
+	{
+		console_line("commands: status, pitch|feed <mm>, tpi|module|dp <n>, params,");
+		console_line("set backlash|accel|rapid|jog <value>, telemetry on|off,");
+		console_line("blackbox [clear], diag, boot, spincomp [learn <turns>], pitchref");
+	}
 }
 
 
 void main (void)
 {
+	watchdog_init();
+	blackbox_init(watchdog_reset_cause() == RESET_POWER);
 	clock_init ();
+	boot_time[BOOT_CLOCK] = clock_boot_us();
+
+	// Get back to following the spindle first, which matters most after
+	// a reset in the middle of a cut, and bring the rest up after that.
+	// Coming back from a watchdog reset the carriage waits for the fault
+	// to be cleared rather than carrying on from wherever it was.
 	spindle_encoder_init();
 	servo_init();
-	display_init();
+	feedback_init();
+	if(watchdog_reset_cause() == RESET_WATCHDOG)
+		fault = FAULT_WATCHDOG;
+	clock_start();
+	boot_time[BOOT_CONTROL] = clock_boot_us();
+
 	input_init();
+	serial_init();
+	display_init();
 
-	delay_msec(500);
+	// The MAX7219 only needs its supply to have settled, the control
+	// loop is already running in the meantime
+	while(clock_boot_us() < DISPLAY_POWER_UP_TIME * 1000)
+		watchdog_checkin(WATCHDOG_MAIN);
 
 	// decode first 4
 	display_write(MAX7219_DECODE_MODE, 0x0f);
@@ -359,11 +1788,19 @@ void main (void)
 	display_write(MAX7219_DISPLAY_TEST, 0);
 	// enable
 	display_write(MAX7219_SHUTDOWN, 1);
-
+	boot_time[BOOT_DISPLAY] = clock_boot_us();
 
 	while(TRUE)
 	{
+		watchdog_checkin(WATCHDOG_MAIN);
 		ui_update();
+		if(boot_time[BOOT_READY] == 0)
+			boot_time[BOOT_READY] = clock_boot_us();
+		char* line = console_read_line();
+		if(line)
+			console_command(line);
+		telemetry_update();
+		spindle_comp_update();
 		delay_msec(10);
 	}
 }
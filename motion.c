@@ -0,0 +1,152 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+
+#include "config.h"
+#include "ramfunc.h"
+#include "motion.h"
+#include "servo.h"
+
+
+// Acceleration in steps per tick per tick, 16.16 fixed point
+static uint32_t accel = MOTION_ACCEL(ACCELERATION);
+
+// Fastest the step timer can go, in steps per tick, 16.16 fixed point.
+// Speeds from the config or console are held to it so that a profile
+// never plans more steps than can be made.
+#define MAX_SPEED   ((uint32_t)STEP_RATE_MAX << 16)
+
+
+static RAMFUNC uint32_t isqrt(uint32_t x)
+{
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+
+	while(bit > x)
+		bit >>= 2;
+	while(bit != 0)
+	{
+		if(x >= root + bit)
+		{
+			x -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return root;
+}
+
+// Returns the most steps the carriage can make in this tick and still
+// be able to stop dead within distance steps without decelerating
+// harder than ACCELERATION
+RAMFUNC uint32_t motion_brake_limit(uint32_t distance)
+{
+	if(distance == 0)
+		return 0;
+
+	uint64_t squared = ((uint64_t)2 * accel * distance) >> 16;
+	uint32_t limit = squared > 0xffffffff ? 0xffff : isqrt(squared);
+
+	// Always make some progress, but never overshoot
+	if(limit < 1)
+		limit = 1;
+	if(limit > distance)
+		limit = distance;
+
+	return limit;
+}
+
+// Takes effect from the next tick, so only call with interrupts disabled
+void motion_set_acceleration(uint32_t acceleration)
+{
+	accel = acceleration;
+}
+
+RAMFUNC void motion_reset(motion_t* motion)
+{
+	motion->speed = 0;
+	motion->fraction = 0;
+	motion->reverse = 0;
+}
+
+// Returns the steps to make in this tick to travel distance steps with a
+// trapezoidal speed profile, accelerating up to max_speed (steps per tick,
+// 16.16 fixed point) and then braking to arrive exactly on the target.
+// Only the speed is kept between ticks, so the distance can be recalculated
+// each time from wherever the carriage actually is.
+RAMFUNC int32_t motion_update(motion_t* motion, int32_t distance, uint32_t max_speed)
+{
+	uint32_t remaining = distance < 0 ? 0 - distance : distance;
+
+	if(max_speed > MAX_SPEED)
+		max_speed = MAX_SPEED;
+	motion->speed += accel;
+	if(motion->speed > max_speed)
+		motion->speed = max_speed;
+	uint32_t limit = motion_brake_limit(remaining);
+	if(motion->speed > (limit << 16))
+		motion->speed = limit << 16;
+
+	motion->fraction += motion->speed;
+	uint32_t steps = motion->fraction >> 16;
+	motion->fraction &= 0xffff;
+	if(steps > remaining)
+		steps = remaining;
+
+	return distance < 0 ? 0 - (int32_t)steps : (int32_t)steps;
+}
+
+// Returns the steps to make in this tick to run at a steady speed (steps
+// per tick, 16.16 fixed point, negative for backwards), accelerating or
+// decelerating towards it at ACCELERATION. The fractional steps are
+// accumulated from tick to tick, so any speed can be held exactly.
+// Changing direction brakes to a stop before setting off the other way.
+RAMFUNC int32_t motion_run(motion_t* motion, int32_t speed)
+{
+	uint8_t reverse = speed < 0;
+	uint32_t target = reverse ? 0 - speed : speed;
+	if(target > MAX_SPEED)
+		target = MAX_SPEED;
+
+	if(reverse != motion->reverse)
+	{
+		if(motion->speed == 0)
+			motion->reverse = reverse;
+		else
+			target = 0;
+	}
+
+	if(motion->speed < target)
+		motion->speed = target - motion->speed > accel ? motion->speed + accel : target;
+	else if(motion->speed > target)
+		motion->speed = motion->speed - target > accel ? motion->speed - accel : target;
+
+	motion->fraction += motion->speed;
+	int32_t steps = motion->fraction >> 16;
+	motion->fraction &= 0xffff;
+
+	return motion->reverse ? 0 - steps : steps;
+}
@@ -0,0 +1,17 @@
+
+typedef struct
+{
+	uint32_t speed;     // steps per tick, 16.16 fixed point
+	uint32_t fraction;  // part step carried over to the next tick
+	uint8_t reverse;    // direction for motion_run()
+} motion_t;
+
+#define MOTION_STEPS_PER_MM       (DRIVE_RATIO * STEPPER_PULSES / LEADSCREW_PITCH)
+#define MOTION_SPEED(mm_per_sec)  ((uint32_t)((mm_per_sec) * MOTION_STEPS_PER_MM / 1000.0 * 65536))
+#define MOTION_ACCEL(mm_per_sec2) ((uint32_t)((mm_per_sec2) * MOTION_STEPS_PER_MM / 1000000.0 * 65536))
+
+uint32_t motion_brake_limit(uint32_t distance);
+void motion_set_acceleration(uint32_t acceleration);
+void motion_reset(motion_t* motion);
+int32_t motion_update(motion_t* motion, int32_t distance, uint32_t max_speed);
+int32_t motion_run(motion_t* motion, int32_t speed);
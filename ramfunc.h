@@ -0,0 +1,8 @@
+// The control loop goes in RAM for the fast build (make PROFILE=fast),
+// where it runs without the flash wait states, and is optimised for speed
+// rather than size like everything else
+#ifdef FAST_PROFILE
+#define RAMFUNC __attribute__((section(".ramfunc"), optimize("O2")))
+#else
+#define RAMFUNC
+#endif
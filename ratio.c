@@ -0,0 +1,226 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+
+#include "config.h"
+#include "ramfunc.h"
+#include "ratio.h"
+#include "servo.h"
+
+
+// The machine as exact integers, lengths in nm
+#define RATIO_DRIVE         ((uint64_t)(DRIVE_RATIO * 1000 + 0.5))     // thousandths
+#define RATIO_STEPPER       ((uint64_t)(STEPPER_PULSES + 0.5))
+#define RATIO_ENCODER       ((uint64_t)(ENCODER_PULSES + 0.5))
+#define RATIO_LEADSCREW     ((uint64_t)(LEADSCREW_PITCH * 1000000 + 0.5))
+#define RATIO_FEEDSCREW     ((uint64_t)(FEEDSCREW_PITCH * 1000000 + 0.5))
+#define RATIO_INCH          25400000ULL
+
+// Pi to better than one part in 10^9
+#define PI_NUM              103993ULL
+#define PI_DEN              33102ULL
+
+
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+	while(b != 0)
+	{
+		uint64_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+// Multiplies num/den by mul_num/mul_den, cancelling common factors first
+// so as to stay inside 64 bits. Returns 0 if it still doesn't fit.
+static uint8_t multiply(uint64_t* num, uint64_t* den, uint64_t mul_num, uint64_t mul_den)
+{
+	uint64_t g1 = gcd(*num, mul_den);
+	uint64_t g2 = gcd(mul_num, *den);
+	uint64_t n = *num / g1;
+	uint64_t d = *den / g2;
+	mul_num /= g2;
+	mul_den /= g1;
+
+	if(n != 0 && mul_num > UINT64_MAX / n)
+		return 0;
+	if(d != 0 && mul_den > UINT64_MAX / d)
+		return 0;
+
+	*num = n * mul_num;
+	*den = d * mul_den;
+	return 1;
+}
+
+// Works out the carriage position for a spindle position. The product
+// always fits in 64 bits, and the result wraps around just like the
+// positions themselves do.
+RAMFUNC uint32_t ratio_apply(uint32_t position, uint32_t num, uint32_t den)
+{
+	uint64_t product = (uint64_t)position * num;
+	if(den == RATIO_FIXED_ONE)
+		return product >> 16;
+	return product / den;
+}
+
+// The same for a position with a 16.16 fraction of a count on top, done
+// in two parts so as to stay inside 64 bits
+RAMFUNC uint32_t ratio_apply_fraction(uint32_t position, int32_t fraction, uint32_t num, uint32_t den)
+{
+	if(fraction == 0)
+		return ratio_apply(position, num, den);
+	if(fraction < 0)
+	{
+		position -= 1;
+		fraction += 65536;
+	}
+
+	uint64_t product = (uint64_t)position * num;
+	uint64_t remainder = product % den;
+	uint64_t extra = ((remainder << 16) + (uint64_t)fraction * num) / ((uint64_t)den << 16);
+	return product / den + extra;
+}
+
+// Finds the fraction closest to num/den that fits in 32 bits top and
+// bottom, using continued fractions. Returns the error in parts per
+// billion, positive if the result is too fast.
+int32_t ratio_approximate(uint64_t num, uint64_t den, ratio_t* result)
+{
+	uint64_t p0 = 0, q0 = 1;
+	uint64_t p1 = 1, q1 = 0;
+	uint64_t n = num, d = den;
+
+	while(d != 0)
+	{
+		uint64_t a = n / d;
+
+		// How many times the last convergent can be added on and still fit
+		uint64_t k = a;
+		if(p1 != 0 && (UINT32_MAX - p0) / p1 < k)
+			k = (UINT32_MAX - p0) / p1;
+		if(q1 != 0 && (UINT32_MAX - q0) / q1 < k)
+			k = (UINT32_MAX - q0) / q1;
+
+		if(k < a)
+		{
+			// Out of room, a semiconvergent is only closer than the last
+			// convergent if it's more than half way to the next one
+			if(k * 2 > a)
+			{
+				p1 = k * p1 + p0;
+				q1 = k * q1 + q0;
+			}
+			break;
+		}
+
+		uint64_t p2 = a * p1 + p0;
+		uint64_t q2 = a * q1 + q0;
+		p0 = p1;
+		q0 = q1;
+		p1 = p2;
+		q1 = q2;
+
+		uint64_t r = n - a * d;
+		n = d;
+		d = r;
+	}
+
+	result->num = p1;
+	result->den = q1;
+
+	// p/q - num/den = (p*den - q*num) / (q*den), the top is small enough
+	// that it comes out right even though the products wrap around
+	int64_t diff = (int64_t)(p1 * den - q1 * num);
+	if(diff == 0 || p1 == 0)
+		return 0;
+	uint64_t scale = den;
+	while(scale > UINT32_MAX)
+	{
+		scale >>= 1;
+		diff /= 2;
+	}
+	return diff * 1000000000LL / (int64_t)scale / (int64_t)p1;
+}
+
+// Exact steps per encoder count for a pitch given in thousandths of the
+// family's unit, approximated to fit. Returns the error in parts per
+// billion, or RATIO_INVALID if the pitch can't be done, which includes
+// needing more steps than TIM1 can make below PITCH_MIN_RPM.
+int32_t ratio_for_pitch(uint8_t family, uint32_t value, ratio_t* result)
+{
+	if(value == 0 || family >= RATIO_FAMILIES)
+		return RATIO_INVALID;
+
+	// Pitch in nm
+	uint64_t num;
+	uint64_t den;
+	if(family == RATIO_FAMILY_MM || family == RATIO_FAMILY_FEED)
+	{
+		num = (uint64_t)value * 1000;
+		den = 1;
+	}
+	else if(family == RATIO_FAMILY_TPI)
+	{
+		num = RATIO_INCH * 1000;
+		den = value;
+	}
+	else if(family == RATIO_FAMILY_MODULE)
+	{
+		num = (uint64_t)value * 1000 * PI_NUM;
+		den = PI_DEN;
+	}
+	else
+	{
+		num = RATIO_INCH * 1000 * PI_NUM;
+		den = (uint64_t)value * PI_DEN;
+	}
+
+	// Steps per encoder count for each nm of pitch
+	uint64_t screw = family == RATIO_FAMILY_FEED ? RATIO_FEEDSCREW : RATIO_LEADSCREW;
+	if(!multiply(&num, &den, RATIO_DRIVE * RATIO_STEPPER, screw * 1000 * RATIO_ENCODER))
+		return RATIO_INVALID;
+
+	int32_t error = ratio_approximate(num, den, result);
+	if(result->num == 0 || result->den == 0)
+		return RATIO_INVALID;
+	if(ratio_max_rpm(result->num, result->den) < PITCH_MIN_RPM)
+		return RATIO_INVALID;
+	return error;
+}
+
+// The fastest the spindle can turn with the carriage still keeping up,
+// as tables.py works it out for the fixed pitches
+uint32_t ratio_max_rpm(uint32_t num, uint32_t den)
+{
+	uint64_t rpm = num == 0 ? UINT32_MAX : (uint64_t)STEP_RATE_MAX * 60000 * den / ((uint64_t)num * RATIO_ENCODER);
+	return rpm > UINT32_MAX ? UINT32_MAX : rpm;
+}
+
+// The number of steps for each cycle of the encoder's A input, if it's a
+// whole number that the timers can make by themselves, otherwise 0
+RAMFUNC uint16_t ratio_gear(uint32_t num, uint32_t den)
+{
+	uint64_t steps = (uint64_t)num * RATIO_GEAR_COUNTS;
+	if(den == 0 || steps % den != 0 || steps / den > RATIO_GEAR_MAX)
+		return 0;
+	return steps / den;
+}
@@ -0,0 +1,25 @@
+typedef struct
+{
+	uint32_t num;   // carriage steps
+	uint32_t den;   // per this many encoder counts
+} ratio_t;
+
+#define RATIO_FIXED_ONE  65536   // den for a 16.16 fixed point ratio
+#define RATIO_INVALID    INT32_MIN
+#define RATIO_GEAR_COUNTS 4      // encoder counts for each cycle of its A input
+#define RATIO_GEAR_MAX   256     // steps TIM1 can make from one trigger
+
+// Pitch families for ratio_for_pitch()
+#define RATIO_FAMILY_MM      0   // mm per turn, threading
+#define RATIO_FAMILY_TPI     1   // threads per inch
+#define RATIO_FAMILY_MODULE  2   // metric module worm
+#define RATIO_FAMILY_DP      3   // diametral pitch worm
+#define RATIO_FAMILY_FEED    4   // mm per turn, feeding
+#define RATIO_FAMILIES       5
+
+uint32_t ratio_apply(uint32_t position, uint32_t num, uint32_t den);
+uint32_t ratio_apply_fraction(uint32_t position, int32_t fraction, uint32_t num, uint32_t den);
+int32_t ratio_approximate(uint64_t num, uint64_t den, ratio_t* result);
+int32_t ratio_for_pitch(uint8_t family, uint32_t value, ratio_t* result);
+uint16_t ratio_gear(uint32_t num, uint32_t den);
+uint32_t ratio_max_rpm(uint32_t num, uint32_t den);
@@ -0,0 +1,145 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stm32f103x6.h>
+#include <system_stm32f1xx.h>
+
+#include "config.h"
+#include "serial.h"
+
+
+// Worst case COBS adds one byte in 254, plus the delimiter
+#define TX_BUFFER_SIZE  (SERIAL_FRAME_WORDS * 4 + 4 + (SERIAL_FRAME_WORDS * 4 + 4) / 254 + 2)
+
+
+#define RX_BUFFER_SIZE  64     // must be a power of 2
+
+
+static uint8_t tx_buffer[TX_BUFFER_SIZE];
+static volatile uint8_t rx_buffer[RX_BUFFER_SIZE];
+static volatile uint8_t rx_head = 0;
+static volatile uint8_t rx_tail = 0;
+
+
+void serial_init()
+{
+	// Configure pins, USART1 remapped as PA9 and PA10 drive the servo
+	// PB6 = TX = AF push/pull output (10MHz), not wired on the PCB
+	// PB7 = RX = pulled up input, not wired on the PCB
+	RCC->APB2ENR |= RCC_APB2ENR_IOPBEN | RCC_APB2ENR_AFIOEN | RCC_APB2ENR_USART1EN;
+	RCC->AHBENR |= RCC_AHBENR_DMA1EN | RCC_AHBENR_CRCEN;
+
+	AFIO->MAPR |= AFIO_MAPR_USART1_REMAP;
+
+	GPIOB->CRL &= ~(GPIO_CRL_CNF6 | GPIO_CRL_MODE6 |
+	                GPIO_CRL_CNF7 | GPIO_CRL_MODE7);
+	GPIOB->CRL |= GPIO_CRL_CNF6_1 | GPIO_CRL_MODE6_0;
+	GPIOB->CRL |= GPIO_CRL_CNF7_1;
+	GPIOB->ODR |= GPIO_ODR_ODR7;
+
+	// 8N1, transmit from DMA1 channel 4, receive on interrupt
+	USART1->BRR = (SystemCoreClock + SERIAL_BAUD / 2) / SERIAL_BAUD;
+	USART1->CR3 = USART_CR3_DMAT;
+	USART1->CR1 = USART_CR1_UE | USART_CR1_TE | USART_CR1_RE | USART_CR1_RXNEIE;
+
+	// Same priority as the control loop so it can never hold it up
+	NVIC_SetPriority(USART1_IRQn, (1UL << __NVIC_PRIO_BITS) - 1UL);
+	NVIC_EnableIRQ(USART1_IRQn);
+
+	DMA1_Channel4->CPAR = (uint32_t)(uintptr_t)&USART1->DR;
+	DMA1_Channel4->CMAR = (uint32_t)(uintptr_t)tx_buffer;
+	DMA1_Channel4->CCR = DMA_CCR_MINC | DMA_CCR_DIR;
+}
+
+uint8_t serial_is_busy()
+{
+	return DMA1_Channel4->CNDTR != 0 || (USART1->SR & USART_SR_TC) == 0;
+}
+
+uint8_t serial_send(const uint32_t* words, uint8_t count)
+{
+	if(serial_is_busy() || count > SERIAL_FRAME_WORDS)
+		return 0;
+
+	// CRC-32 (MPEG-2 flavour, as the hardware does it word by word)
+	CRC->CR = CRC_CR_RESET;
+	for(uint8_t i = 0; i < count; ++i)
+		CRC->DR = words[i];
+	uint32_t crc = CRC->DR;
+
+	// COBS encode the words and the CRC so that a zero byte only ever
+	// marks the end of a frame
+	const uint8_t* data = (const uint8_t*)words;
+	uint16_t length = count * 4 + 4;
+	uint16_t code_pos = 0;
+	uint16_t out = 1;
+	uint8_t code = 1;
+	for(uint16_t i = 0; i < length; ++i)
+	{
+		uint8_t byte = i < count * 4 ? data[i] : (uint8_t)(crc >> ((i - count * 4) * 8));
+		if(byte != 0)
+		{
+			tx_buffer[out++] = byte;
+			++code;
+		}
+		if(byte == 0 || code == 0xff)
+		{
+			tx_buffer[code_pos] = code;
+			code_pos = out++;
+			code = 1;
+		}
+	}
+	tx_buffer[code_pos] = code;
+	tx_buffer[out++] = 0;
+
+	DMA1_Channel4->CCR &= ~DMA_CCR_EN;
+	DMA1_Channel4->CNDTR = out;
+	USART1->SR &= ~USART_SR_TC;
+	DMA1_Channel4->CCR |= DMA_CCR_EN;
+
+	return 1;
+}
+
+int16_t serial_read()
+{
+	if(rx_tail == rx_head)
+		return -1;
+
+	uint8_t byte = rx_buffer[rx_tail];
+	rx_tail = (rx_tail + 1) & (RX_BUFFER_SIZE - 1);
+	return byte;
+}
+
+void USART1_IRQHandler()
+{
+	// Reading the data register also clears an overrun
+	uint32_t status = USART1->SR;
+	uint8_t byte = USART1->DR;
+	if(status & USART_SR_RXNE)
+	{
+		uint8_t next = (rx_head + 1) & (RX_BUFFER_SIZE - 1);
+		if(next != rx_tail)
+		{
+			rx_buffer[rx_head] = byte;
+			rx_head = next;
+		}
+	}
+}
@@ -0,0 +1,10 @@
+#define SERIAL_FRAME_WORDS  64
+
+// First byte of every frame
+#define SERIAL_FRAME_TELEMETRY  1
+#define SERIAL_FRAME_CONSOLE    2
+
+void serial_init();
+uint8_t serial_is_busy();
+uint8_t serial_send(const uint32_t* words, uint8_t count);
+int16_t serial_read();
@@ -22,9 +22,25 @@
 #include <stm32f103x6.h>
 #include <system_stm32f1xx.h>
 
+#include "ramfunc.h"
 #include "servo.h"
 
 
+// Every pulse's compare event has DMA channel 2 move a dummy half word,
+// so its count going down is a tally of the pulses that actually came out
+#define PULSE_COUNTER   60000
+
+
+static uint16_t pulse_dummy;
+static uint16_t pulse_remaining = PULSE_COUNTER;
+static uint32_t pulses_asked = 0;
+static uint32_t pulses_made = 0;
+static servo_audit_t audit;
+static uint8_t geared = 0;            // trains started by TIM3 rather than servo_step()
+static uint8_t gear_train = 0;        // one of those might still be running
+static uint32_t gear_made = 0;
+
+
 void servo_init()
 {
 	RCC->APB2ENR |= RCC_APB2ENR_IOPAEN;
@@ -40,13 +56,19 @@ void servo_init()
 	// PA10 = alarm = floating input
 	GPIOA->CRH &= ~(GPIO_CRH_CNF10 | GPIO_CRH_MODE10);
 	GPIOA->CRH |= GPIO_CRH_MODE10_0;
+
+	// PA11 = enable = gpio push/pull output (10MHz), enabled. It isn't
+	// connected on the PCB, see the README for wiring it to the drive.
+	GPIOA->CRH &= ~(GPIO_CRH_CNF11 | GPIO_CRH_MODE11);
+	GPIOA->CRH |= GPIO_CRH_MODE11_0;
+	GPIOA->BSRR = GPIO_BSRR_BS11;
 	
 	// Enable TIM1
 	RCC->APB2ENR |= RCC_APB2ENR_TIM1EN;
 
 	// Cnfigure timer 1 for 50% duty cycle, one pulse output, with repeat count
 	TIM1->CR1 &= ~TIM_CR1_CKD;      // no clock division
-	TIM1->ARR = 8;                  // auto reload = 8
+	TIM1->ARR = STEP_PERIOD_US - 1; // auto reload = 8
 	TIM1->CCR1 = 4;                 // compare = 4 (50%)
 	TIM1->PSC = (uint16_t)((SystemCoreClock / 1000000) - 1);    // prescaler
 	TIM1->RCR = 1;                  // repeat count = 1
@@ -58,33 +80,135 @@ void servo_init()
 	TIM1->CCER &= (uint16_t)~TIM_CCER_CC1P;  // output active high
 	TIM1->CCER |= TIM_CCER_CC1E;    // channel 1 output enable
 	TIM1->BDTR |= TIM_BDTR_MOE;     // main output enable
+	TIM1->DIER |= TIM_DIER_CC1DE;   // DMA request on each pulse
+
+	// DMA1 channel 2 counts the pulses
+	RCC->AHBENR |= RCC_AHBENR_DMA1EN;
+	DMA1_Channel2->CCR = 0;
+	DMA1_Channel2->CPAR = (uint32_t)(uintptr_t)&TIM1->CCR1;
+	DMA1_Channel2->CMAR = (uint32_t)(uintptr_t)&pulse_dummy;
+	DMA1_Channel2->CNDTR = PULSE_COUNTER;
+	DMA1_Channel2->CCR = DMA_CCR_MSIZE_0 | DMA_CCR_PSIZE_0 |  // 16 bit
+	                     DMA_CCR_CIRC | DMA_CCR_EN;
+
 	TIM1->CR1 |= TIM_CR1_CEN;       // enable
+	pulses_asked = 2;               // for the repeat count of 1
 
 	GPIOA->BSRR |= GPIO_BSRR_BS9;
 }
 
-uint8_t servo_is_idle()
+RAMFUNC uint8_t servo_is_idle()
 {
 	return (TIM1->CR1 & TIM_CR1_CEN) == 0;
 }
 
-void servo_set_direction(uint8_t reverse)
+RAMFUNC void servo_set_direction(uint8_t reverse)
 {	
+	// The end of a running train would go the wrong way
+	if(!servo_is_idle() && ((GPIOA->ODR & GPIO_ODR_ODR9) != 0) != (reverse != 0))
+		audit.reversals += 1;
 	GPIOA->BSRR |= reverse ? GPIO_BSRR_BS9 : GPIO_BSRR_BR9;
 }
 
-void servo_step(uint8_t steps)
+RAMFUNC void servo_enable(uint8_t enable)
+{
+	GPIOA->BSRR = enable ? GPIO_BSRR_BS11 : GPIO_BSRR_BR11;
+}
+
+RAMFUNC uint8_t servo_is_enabled()
+{
+	return (GPIOA->ODR & GPIO_ODR_ODR11) != 0;
+}
+
+RAMFUNC void servo_step(uint8_t steps)
 {
 	TIM1->RCR = steps - 1;
+	TIM1->EGR = TIM_EGR_UG;     // load the repeat count now, not at the end of this train
 	TIM1->CR1 |= TIM_CR1_CEN;
+	pulses_asked += steps;
 }
 
-void servo_stop()
+// Has TIM1 make a train of pulses by itself from every trigger from TIM3,
+// one for each cycle of the spindle encoder's A input, with extra pulses
+// on the first to catch up, or goes back to only making them when asked
+// with 0. A train that's running carries on to the end.
+RAMFUNC void servo_gear(uint16_t pulses, uint8_t extra)
+{
+	if(pulses > 0)
+	{
+		// The repeat count for the rest is loaded at the end of the first
+		TIM1->RCR = pulses + extra - 1;
+		TIM1->EGR = TIM_EGR_UG;
+		TIM1->RCR = pulses - 1;
+		TIM1->SMCR = TIM_SMCR_TS_1 | TIM_SMCR_SMS_2 | TIM_SMCR_SMS_1;  // trigger mode from ITR2
+	}
+	else
+	{
+		TIM1->SMCR = 0;
+	}
+	geared = pulses > 0;
+	gear_train |= geared;
+}
+
+// Keeps the tally of pulses made up to date, those from the triggers
+// being kept apart and counted as asked for
+static RAMFUNC void count_pulses()
+{
+	uint16_t remaining = DMA1_Channel2->CNDTR;
+	uint32_t made = (pulse_remaining - remaining + PULSE_COUNTER) % PULSE_COUNTER;
+	pulse_remaining = remaining;
+	pulses_made += made;
+	if(gear_train)
+	{
+		gear_made += made;
+		pulses_asked += made;
+		gear_train = geared || !servo_is_idle();
+	}
+}
+
+// Returns the pulses made from the triggers since last time
+RAMFUNC uint32_t servo_gear_steps()
+{
+	count_pulses();
+	uint32_t made = gear_made;
+	gear_made = 0;
+	return made;
+}
+
+RAMFUNC void servo_stop()
 {
 	TIM1->CR1 &= ~TIM_CR1_CEN;  // stop servo pulses
 }
 
-uint8_t servo_alarm_get()
+// Checks the pulses that actually came out against those asked for, once
+// each train has finished, so that a train cut short or an extra pulse
+// doesn't silently leave the carriage out of step. Returns how many more
+// were made than asked for since last time, and has to be called every
+// tick so the pulse counter can't go all the way round.
+RAMFUNC int32_t servo_audit()
+{
+	count_pulses();
+	if(!servo_is_idle() || gear_train)
+		return 0;
+	int32_t miscount = (int32_t)(pulses_made - pulses_asked);
+	if(miscount == 0)
+		return 0;
+
+	if(miscount < 0)
+		audit.lost += 0 - miscount;
+	else
+		audit.extra += miscount;
+	audit.mismatches += 1;
+	pulses_asked = pulses_made;
+	return miscount;
+}
+
+void servo_audit_get(servo_audit_t* result)
+{
+	*result = audit;
+}
+
+RAMFUNC uint8_t servo_alarm_get()
 {
 	static uint8_t value = 0;
 	static uint8_t last_value = 0;
@@ -1,7 +1,27 @@
+// Each step takes one period of TIM1 at 1MHz, which limits how many can be
+// made in a 1ms tick
+#define STEP_PERIOD_US      9
+#define STEP_RATE_MAX       (1000 / STEP_PERIOD_US)
+
+// Pulses that didn't come out as asked for, since power on
+typedef struct
+{
+	uint32_t lost;          // asked for but not made
+	uint32_t extra;         // made without being asked for
+	uint16_t mismatches;    // trains that came out wrong
+	uint16_t reversals;     // direction changes while a train was running
+} servo_audit_t;
+
 
 void servo_init();
 uint8_t servo_is_idle();
 void servo_set_direction(uint8_t reverse);
+void servo_enable(uint8_t enable);
+uint8_t servo_is_enabled();
 void servo_step(uint8_t steps);
 void servo_stop();
 uint8_t servo_alarm_get();
+int32_t servo_audit();
+void servo_gear(uint16_t pulses, uint8_t extra);
+uint32_t servo_gear_steps();
+void servo_audit_get(servo_audit_t* result);
@@ -23,14 +23,76 @@
 #include <system_stm32f1xx.h>
 
 #include "config.h"
+#include "ramfunc.h"
+#include "clock.h"
 #include "spindle_encoder.h"
 
 
+#define TRUE  1
+#define FALSE 0
+
+// The counter is copied into a history by DMA, paced by the ADC which
+// converts the internal reference over and over just for its timing.
+// Each conversion takes 252 ADC clocks at SYSCLK / 6, about 47.6kHz.
+// With an analog encoder the ADCs convert its sine and cosine instead,
+// both at once, and those are what's copied.
+#define HISTORY      64     // samples, a power of two
+#define WINDOW       48     // newest samples used, well clear of the DMA
+#define SPAN         8      // ticks between velocities for the acceleration
+#define ADC_CYCLES   252    // 239.5 sampling + 12.5 conversion
+
+// Sum of the squared weights 2k - (n - 1) used for a least squares slope
+#define SQUARES(n)   ((int64_t)(n) * ((n) * (n) - 1) / 3)
+
+// Angles are 65536 to a cycle of sine and cosine, which is 4 counts
+#define CYCLE        (4 * 65536)       // in 16.16 counts
+#define ANALOG_MID   2048              // ADC reading for 0V from the encoder
+
+
+static volatile union
+{
+	uint16_t counts[HISTORY];
+	uint32_t analog[HISTORY];          // ADC2 (cosine) << 16 | ADC1 (sine)
+} history;
+static int64_t samples_per_ms = 0;     // 16.16
+
+// atan(i / 128) for the first eighth of a turn, 65536 to the turn
+static const uint16_t atans[129] =
+{
+	   0,   81,  163,  244,  326,  407,  489,  570,  651,  732,  813,  894,
+	 975, 1056, 1136, 1217, 1297, 1377, 1457, 1537, 1617, 1696, 1775, 1854,
+	1933, 2012, 2090, 2168, 2246, 2324, 2401, 2478, 2555, 2632, 2708, 2784,
+	2860, 2935, 3010, 3085, 3159, 3233, 3307, 3380, 3453, 3526, 3599, 3670,
+	3742, 3813, 3884, 3955, 4025, 4095, 4164, 4233, 4302, 4370, 4438, 4505,
+	4572, 4639, 4705, 4771, 4836, 4901, 4966, 5030, 5094, 5157, 5220, 5282,
+	5344, 5406, 5467, 5528, 5589, 5649, 5708, 5768, 5826, 5885, 5943, 6000,
+	6058, 6114, 6171, 6227, 6282, 6337, 6392, 6446, 6500, 6554, 6607, 6660,
+	6712, 6764, 6815, 6867, 6917, 6968, 7018, 7068, 7117, 7166, 7214, 7262,
+	7310, 7358, 7405, 7451, 7498, 7544, 7589, 7635, 7679, 7724, 7768, 7812,
+	7856, 7899, 7942, 7984, 8026, 8068, 8110, 8151, 8192
+};
+
+// Last analog position given out, and the most cycles a sample has taken
+static uint32_t analog_position = 0;   // 16.16 counts
+static uint32_t analog_cycles_max = 0;
+
+// When the last count came and how long the one before it took, in
+// samples, for interpolating between counts
+static uint32_t sample_clock = 0;
+static uint8_t last_index = 0;
+static uint32_t edge_time = 0;
+static uint32_t edge_period = 0;
+static int8_t edge_direction = 0;
+
+
 void spindle_encoder_init()
 {
 	// Configure pins
 	// PB4 = T3C1
 	// PB5 = T3C2
+	// PB0 = T3C3 = index, not wired on the PCB
+	// PA3 = sine, analog, not wired on the PCB
+	// PB1 = cosine, analog, not wired on the PCB
 
 	// Enable GPIOB
 	RCC->APB2ENR |= RCC_APB2ENR_IOPBEN;
@@ -44,6 +106,9 @@ void spindle_encoder_init()
 	                GPIO_CRL_CNF5 | GPIO_CRL_MODE5);
 	GPIOB->CRL |= GPIO_CRL_CNF4_1 | GPIO_CRL_CNF5_1; // T3C1/T3C2 = pulled input
 	GPIOB->ODR |= GPIO_ODR_ODR4 | GPIO_ODR_ODR5;     // T3C1/T3C2 = pulled up
+	GPIOB->CRL &= ~(GPIO_CRL_CNF0 | GPIO_CRL_MODE0);
+	GPIOB->CRL |= GPIO_CRL_CNF0_1;                   // index = pulled input
+	GPIOB->ODR |= GPIO_ODR_ODR0;                     // index = pulled up
 
 	RCC->APB1ENR |= RCC_APB1ENR_TIM3EN;
 
@@ -55,13 +120,80 @@ void spindle_encoder_init()
 	// Switch polarity of one of the inputs
 	TIM3->CCER |= TIM_CCER_CC1P;
 #endif
+	// Capture the count on the rising edge of the index on channel 3,
+	// filtered over 8 clocks
+	TIM3->CCMR2 |= TIM_CCMR2_CC3S_0 | TIM_CCMR2_IC3F_0 | TIM_CCMR2_IC3F_1;
+	TIM3->CCER  |= TIM_CCER_CC3E;
+	// Capture on each cycle of TI1, only so that its trigger output
+	// pulses for TIM1 to make steps from when geared
+	TIM3->CCER  |= TIM_CCER_CC1E;
+	TIM3->CR2   |= TIM_CR2_MMS_0 | TIM_CR2_MMS_1;   // compare pulse
 	// Set encoder mode, counting both edges
 	TIM3->SMCR  |= TIM_SMCR_SMS_0 | TIM_SMCR_SMS_1;
 	// Start the timer
 	TIM3->CR1   |= TIM_CR1_CEN;
+
+	// DMA1 channel 1 copies the counter on each ADC1 end of conversion,
+	// or both ADC results from ADC1 in dual mode
+	RCC->AHBENR |= RCC_AHBENR_DMA1EN;
+	DMA1_Channel1->CCR = 0;
+	DMA1_Channel1->CNDTR = HISTORY;
+	if(SPINDLE_ANALOG)
+	{
+		DMA1_Channel1->CPAR = (uint32_t)(uintptr_t)&ADC1->DR;
+		DMA1_Channel1->CMAR = (uint32_t)(uintptr_t)history.analog;
+		DMA1_Channel1->CCR = DMA_CCR_MSIZE_1 | DMA_CCR_PSIZE_1 |  // 32 bit
+		                     DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_EN;
+	}
+	else
+	{
+		DMA1_Channel1->CPAR = (uint32_t)(uintptr_t)&TIM3->CNT;
+		DMA1_Channel1->CMAR = (uint32_t)(uintptr_t)history.counts;
+		DMA1_Channel1->CCR = DMA_CCR_MSIZE_0 | DMA_CCR_PSIZE_0 |  // 16 bit
+		                     DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_EN;
+	}
+
+	RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_ADCPRE) | RCC_CFGR_ADCPRE_DIV6;
+	RCC->APB2ENR |= RCC_APB2ENR_ADC1EN;
+	ADC1->SQR1 = 0;                          // one conversion
+	if(SPINDLE_ANALOG)
+	{
+		// ADC1 converting the sine and ADC2 the cosine at the same time,
+		// continuously at 12MHz, started by ADC1
+		RCC->APB2ENR |= RCC_APB2ENR_IOPAEN | RCC_APB2ENR_ADC2EN;
+		GPIOA->CRL &= ~(GPIO_CRL_CNF3 | GPIO_CRL_MODE3);   // analog
+		GPIOB->CRL &= ~(GPIO_CRL_CNF1 | GPIO_CRL_MODE1);
+		ADC1->CR1 = ADC_CR1_DUALMOD_2 | ADC_CR1_DUALMOD_1;  // regular simultaneous
+		ADC1->SQR3 = 3;
+		ADC1->SMPR2 = ADC_SMPR2_SMP3;            // 239.5 cycles
+		ADC2->SQR1 = 0;
+		ADC2->SQR3 = 9;
+		ADC2->SMPR2 = ADC_SMPR2_SMP9;
+		ADC2->CR2 = ADC_CR2_ADON | ADC_CR2_CONT | ADC_CR2_EXTSEL | ADC_CR2_EXTTRIG;
+		ADC1->CR2 = ADC_CR2_ADON | ADC_CR2_CONT | ADC_CR2_DMA | ADC_CR2_EXTSEL | ADC_CR2_EXTTRIG;
+		for(volatile uint8_t i = 0; i < 100; ++i)  // power up
+			;
+		ADC2->CR2 |= ADC_CR2_CAL;
+		ADC1->CR2 |= ADC_CR2_CAL;
+		while((ADC1->CR2 | ADC2->CR2) & ADC_CR2_CAL)
+			;
+		ADC1->CR2 |= ADC_CR2_SWSTART;            // start
+	}
+	else
+	{
+		// ADC1 converting the internal reference continuously, at 12MHz
+		ADC1->SQR3 = 17;                         // of the reference
+		ADC1->SMPR1 = ADC_SMPR1_SMP17;           // 239.5 cycles
+		ADC1->CR2 = ADC_CR2_ADON | ADC_CR2_CONT | ADC_CR2_DMA | ADC_CR2_TSVREFE;
+		for(volatile uint8_t i = 0; i < 100; ++i)  // power up
+			;
+		ADC1->CR2 |= ADC_CR2_ADON;               // start
+	}
+
+	samples_per_ms = ((int64_t)SystemCoreClock << 16) / (6 * ADC_CYCLES * 1000);
 }
 
-uint16_t spindle_encoder_get()
+RAMFUNC uint16_t spindle_encoder_get()
 {
 	//static uint16_t pos = 0;
 	//pos += 100;
@@ -69,3 +201,192 @@ uint16_t spindle_encoder_get()
 	return TIM3->CNT;
 }
 
+// Returns whether the index has gone past since last time, and the count
+// at the moment it did
+RAMFUNC uint8_t spindle_encoder_index(uint16_t* position)
+{
+	if(!(TIM3->SR & TIM_SR_CC3IF))
+		return 0;
+	*position = TIM3->CCR3;    // and clears the flag
+	return 1;
+}
+
+// Angle of num / den up to 45 degrees, num <= den, from the table
+static RAMFUNC uint16_t arctan(uint32_t num, uint32_t den)
+{
+	uint32_t t = (num << 15) / den;    // 0 to 32768
+	uint32_t i = t >> 8;
+	if(i == 128)
+		return atans[128];
+	return atans[i] + (((atans[i + 1] - atans[i]) * (t & 0xff)) >> 8);
+}
+
+// Angle of a sine and cosine pair from the ADCs, 65536 to a cycle, lined
+// up so that the count steps over a multiple of 4 at 0
+static RAMFUNC uint16_t analog_angle(uint32_t sample)
+{
+	int32_t y = (int32_t)(sample & 0xffff) - ANALOG_MID;
+	int32_t x = (int32_t)(sample >> 16) - ANALOG_MID;
+	uint32_t ax = x < 0 ? -x : x;
+	uint32_t ay = y < 0 ? -y : y;
+	if(ax == 0 && ay == 0)
+		return 0;
+
+	// Folded into the first eighth of a turn and back out
+	uint16_t angle = ay <= ax ? arctan(ay, ax) : 16384 - arctan(ax, ay);
+	if(x < 0)
+		angle = 32768 - angle;
+	if(y < 0)
+		angle = -angle;
+#ifdef REVERSE_DIRECTION
+	angle = -angle;    // the counter has A the other way up
+#endif
+	return angle + SPINDLE_ANALOG_PHASE;
+}
+
+// Position of the spindle in 16.16 counts from an angle and a count taken
+// at about the same time. The angle says where it is within a cycle of 4
+// counts, and the count which cycle, as long as the two agree to within
+// 2 counts.
+static RAMFUNC uint32_t analog_combine(uint16_t angle, uint16_t count)
+{
+	uint32_t position = ((uint32_t)(count & ~3) << 16) + ((uint32_t)angle << 2);
+	int32_t difference = position - (((uint32_t)count << 16) + 0x8000);
+	if(difference >= CYCLE / 2)
+		position -= CYCLE;
+	else if(difference < -CYCLE / 2)
+		position += CYCLE;
+	return position;
+}
+
+// Least squares slope of n samples, times SQUARES(n) / 2
+static RAMFUNC int64_t slope(const int32_t* samples, uint8_t n)
+{
+	int64_t sum = 0;
+	for(uint8_t k = 0; k < n; ++k)
+		sum += (int32_t)(2 * k - (n - 1)) * samples[k];
+	return sum;
+}
+
+// Works out the spindle's velocity in counts per ms and acceleration in
+// counts per ms per ms, both 16.16, once every tick. Fitting a line through
+// the last millisecond or so of history rather than taking the difference
+// of two positions gets well under a count per ms at low speed. Within a
+// millisecond the counts are too coarse for the acceleration though, so
+// that comes from the velocity over the last few ticks.
+RAMFUNC void spindle_encoder_motion(int32_t* velocity, int32_t* acceleration)
+{
+	static int32_t velocities[SPAN];
+	static uint8_t next = 0;
+
+	static uint16_t last_count = 0;
+	static uint32_t last_ticks = 0;
+
+	int32_t samples[WINDOW];
+	uint8_t newest = (HISTORY - DMA1_Channel1->CNDTR + HISTORY - 1) % HISTORY;
+	uint8_t first = (newest - (WINDOW - 1)) & (HISTORY - 1);
+	if(SPINDLE_ANALOG)
+	{
+		// Positions in 16.16 counts from the angles, each step from one to
+		// the next taken as the nearest to what the counter says it should
+		// be. The counter is only good to a count or so a millisecond but
+		// that's plenty when it only has to be right to within 2 counts a
+		// sample, and it can't get stuck a whole cycle a sample out the way
+		// the last velocity could.
+		uint32_t start = get_cycles();
+		uint16_t count = TIM3->CNT;
+		uint32_t now = ticks;
+		uint32_t elapsed = now != last_ticks ? now - last_ticks : 1;
+		int32_t coarse = ((int32_t)(int16_t)(count - last_count) << 16) / (int32_t)elapsed;
+		int32_t expected = ((int64_t)coarse << 14) / samples_per_ms;  // per sample, as an angle
+		last_count = count;
+		last_ticks = now;
+		uint16_t last = analog_angle(history.analog[first]);
+		samples[0] = 0;
+		for(uint8_t k = 1; k < WINDOW; ++k)
+		{
+			uint16_t angle = analog_angle(history.analog[(first + k) & (HISTORY - 1)]);
+			int32_t step = (int16_t)(angle - last - expected) + expected;
+			samples[k] = samples[k - 1] + step * 4;
+			last = angle;
+		}
+		uint32_t cycles = (get_cycles() - start) / WINDOW;
+		if(cycles > analog_cycles_max)
+			analog_cycles_max = cycles;
+
+		*velocity = (2 * slope(samples, WINDOW) * samples_per_ms / SQUARES(WINDOW)) >> 16;
+	}
+	else
+	{
+		uint16_t base = history.counts[first];
+		for(uint8_t k = 0; k < WINDOW; ++k)
+			samples[k] = (int16_t)(history.counts[(first + k) & (HISTORY - 1)] - base);
+
+		*velocity = 2 * slope(samples, WINDOW) * samples_per_ms / SQUARES(WINDOW);
+	}
+
+	*acceleration = (*velocity - velocities[next]) / SPAN;
+	velocities[next] = *velocity;
+	next = (next + 1) % SPAN;
+}
+
+// Estimates how far the spindle has got towards its next count, as a
+// 16.16 fraction of a count on from position, negative when turning
+// backwards. Between counts it carries on at the rate the last count
+// came, stopping just short of the next one until that actually comes.
+// Has to be called every tick so as not to miss any samples.
+RAMFUNC int32_t spindle_encoder_interpolate(uint16_t position)
+{
+	// An analog encoder says where it is outright, from the newest sample.
+	// Changes smaller than the noise are left out so the spindle can be
+	// seen to stop.
+	if(SPINDLE_ANALOG)
+	{
+		uint8_t newest = (HISTORY - DMA1_Channel1->CNDTR + HISTORY - 1) % HISTORY;
+		uint32_t now = analog_combine(analog_angle(history.analog[newest]), position);
+		int32_t change = now - analog_position;
+		if(change > SPINDLE_ANALOG_DEADBAND || change < -SPINDLE_ANALOG_DEADBAND)
+			analog_position = now;
+		return analog_position - ((uint32_t)position << 16);
+	}
+
+	// Find the counts since last time, timed to within a sample
+	uint8_t index = (HISTORY - DMA1_Channel1->CNDTR) % HISTORY;
+	uint8_t count = (index - last_index) & (HISTORY - 1);
+	for(uint8_t i = 0; i < count; ++i)
+	{
+		uint8_t k = (last_index + i) & (HISTORY - 1);
+		int16_t change = (int16_t)(history.counts[k] - history.counts[(k - 1) & (HISTORY - 1)]);
+		if(change == 0)
+			continue;
+
+		int8_t direction = change > 0 ? 1 : -1;
+		uint32_t time = sample_clock + i;
+		if(direction == edge_direction)
+			edge_period = (time - edge_time) / (change * direction);
+		else
+			edge_period = 0;    // nothing to go on until the next count
+		edge_time = time;
+		edge_direction = direction;
+	}
+	sample_clock += count;
+	last_index = index;
+
+	// Only if the newest sample is where the counter is now
+	if(edge_period == 0 || history.counts[(index - 1) & (HISTORY - 1)] != position)
+		return 0;
+
+	uint32_t since = sample_clock - 1 - edge_time;
+	int32_t fraction = since >= edge_period ? 0xffff : ((uint64_t)since << 16) / edge_period;
+	return fraction * edge_direction;
+}
+
+// Most CPU cycles a sine and cosine sample has taken to turn into a
+// position, for the diagnostics
+uint32_t spindle_encoder_cycles()
+{
+	uint32_t cycles = analog_cycles_max;
+	analog_cycles_max = 0;
+	return cycles;
+}
+
@@ -1,2 +1,6 @@
 void spindle_encoder_init();
 uint16_t spindle_encoder_get();
+uint8_t spindle_encoder_index(uint16_t* position);
+void spindle_encoder_motion(int32_t* velocity, int32_t* acceleration);
+int32_t spindle_encoder_interpolate(uint16_t position);
+uint32_t spindle_encoder_cycles();
@@ -0,0 +1,104 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+
+#include "config.h"
+#include "ramfunc.h"
+#include "serial.h"
+#include "telemetry.h"
+
+
+#define TELEMETRY_SAMPLES   32      // must be a power of 2
+#define WORDS_PER_SAMPLE    3
+#define SAMPLES_PER_FRAME   ((SERIAL_FRAME_WORDS - 1) / WORDS_PER_SAMPLE)
+
+
+typedef struct
+{
+	uint32_t tick;
+	uint32_t position;
+	int16_t steps;
+	int16_t lag;
+} telemetry_sample_t;
+
+static telemetry_sample_t samples[TELEMETRY_SAMPLES];
+static volatile uint8_t head = 0;
+static volatile uint8_t tail = 0;
+static volatile uint16_t dropped = 0;
+static volatile uint8_t enabled = 1;
+
+
+void telemetry_enable(uint8_t enable)
+{
+	enabled = enable;
+}
+
+RAMFUNC void telemetry_push(uint32_t tick, uint32_t position, int16_t steps, int16_t lag)
+{
+	if(!enabled)
+		return;
+
+	uint8_t next = (head + 1) & (TELEMETRY_SAMPLES - 1);
+	if(next == tail)
+	{
+		++dropped;
+		return;
+	}
+
+	telemetry_sample_t* sample = &samples[head];
+	sample->tick = tick;
+	sample->position = position;
+	sample->steps = steps;
+	sample->lag = lag;
+	head = next;
+}
+
+void telemetry_update()
+{
+	static uint16_t dropped_sent = 0;
+	static uint32_t frame[1 + SAMPLES_PER_FRAME * WORDS_PER_SAMPLE];
+
+	if(serial_is_busy() || head == tail)
+		return;
+
+	// The control loop only ever adds samples and this only ever takes
+	// them away, so the two don't need to lock each other out
+	uint8_t index = tail;
+	uint8_t count = 0;
+	uint16_t dropped_now = dropped;
+	uint32_t* word = &frame[1];
+	while(index != head && count < SAMPLES_PER_FRAME)
+	{
+		telemetry_sample_t* sample = &samples[index];
+		*word++ = sample->tick;
+		*word++ = sample->position;
+		*word++ = (uint16_t)sample->steps | ((uint32_t)(uint16_t)sample->lag << 16);
+		index = (index + 1) & (TELEMETRY_SAMPLES - 1);
+		++count;
+	}
+	frame[0] = SERIAL_FRAME_TELEMETRY | (count << 8) | ((uint32_t)(uint16_t)(dropped_now - dropped_sent) << 16);
+
+	if(serial_send(frame, 1 + count * WORDS_PER_SAMPLE))
+	{
+		tail = index;
+		dropped_sent = dropped_now;
+	}
+}
@@ -0,0 +1,3 @@
+void telemetry_enable(uint8_t enable);
+void telemetry_push(uint32_t tick, uint32_t position, int16_t steps, int16_t lag);
+void telemetry_update();
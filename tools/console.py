@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+#
+#   Copyright (C) 2023 Stephen Robinson
+#
+#   This file is part of Sieg SC4 ELS
+#
+#   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   Sieg SC4 ELS is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this code (see the file names COPING).
+#   If not, see <http://www.gnu.org/licenses/>.
+#
+# Talks to the controller's serial console:
+#
+#   stty -F /dev/ttyUSB0 460800 raw
+#   tools/console.py /dev/ttyUSB0
+#
+# Commands typed (or piped in) are sent as plain lines, the replies come
+# back framed like the telemetry and are printed as text. Telemetry
+# frames are ignored, "telemetry off" stops them being sent at all.
+
+import os
+import select
+import struct
+import sys
+
+from telemetry import decode_frame
+
+FRAME_CONSOLE = 2
+
+
+def reply(words):
+    # The text of a console frame, or None for any other kind
+    if words[0] & 0xff != FRAME_CONSOLE:
+        return None
+    length = (words[0] >> 8) & 0xff
+    text = struct.pack("<%dI" % (len(words) - 1), *words[1:])[:length]
+    return text.decode(errors="replace")
+
+
+def main():
+    path = sys.argv[1] if len(sys.argv) > 1 else "/dev/ttyUSB0"
+    port = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    buffer = bytearray()
+    inputs = [port, sys.stdin.fileno()]
+
+    while True:
+        readable, _, _ = select.select(inputs, [], [])
+        if sys.stdin.fileno() in readable:
+            line = sys.stdin.readline()
+            if not line:
+                inputs.remove(sys.stdin.fileno())
+                if not inputs:
+                    return
+                continue
+            os.write(port, line.strip().encode() + b"\n")
+
+        if port in readable:
+            data = os.read(port, 256)
+            if not data:
+                return
+            for byte in data:
+                if byte != 0:
+                    buffer.append(byte)
+                    continue
+                encoded = bytes(buffer)
+                buffer.clear()
+                if not encoded:
+                    continue
+                try:
+                    words = decode_frame(encoded)
+                except ValueError as e:
+                    print("# %s" % e, file=sys.stderr)
+                    continue
+                text = reply(words)
+                if text is None:
+                    continue
+                print(text)
+                sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,138 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the analog encoder's angle from its sine and cosine against the
+// bound given for it, then the position from the angle and the count, and
+// the velocity fitted through the angles with noise on the ADC readings,
+// from a simulated encoder of 1500 LSB amplitude about the middle.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "host.h"
+#include "spindle_encoder.c"
+
+
+#define AMPLITUDE    1500    // LSB
+#define NOISE        3.0     // LSB rms
+#define ANGLE_BOUND  6       // of 65536 to a cycle
+#define COMBINE_BOUND 0.001  // counts
+#define SPEED_BOUND  0.002   // counts per ms
+
+static double noise(void)
+{
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static uint16_t reading(double value)
+{
+	long lsb = lround(ANALOG_MID + value);
+	return lsb < 0 ? 0 : lsb > 4095 ? 4095 : lsb;
+}
+
+// ADC2 (cosine) << 16 | ADC1 (sine) at a position in counts
+static uint32_t sample(double counts, double rms)
+{
+	double angle = counts / 4 * 2 * M_PI;
+#ifdef REVERSE_DIRECTION
+	angle = -angle;    // as analog_angle() turns it back round
+#endif
+	return (uint32_t)reading(AMPLITUDE * cos(angle) + rms * noise()) << 16 |
+	       reading(AMPLITUDE * sin(angle) + rms * noise());
+}
+
+int main(void)
+{
+	// spindle_encoder_init() would wait on the ADCs calibrating, so just
+	// the one thing it works out that's needed here
+	samples_per_ms = ((int64_t)SystemCoreClock << 16) / (6 * ADC_CYCLES * 1000);
+	double rate = samples_per_ms / 65536.0;
+	srand(1);
+
+	// All the way round the cycle, with the readings rounded as the ADCs
+	// would but no noise
+	double worst = 0;
+	for(int i = 0; i < 100000; ++i)
+	{
+		double counts = i * 4.0 / 100000;
+		double exact = counts / 4 * 65536 + SPINDLE_ANALOG_PHASE;
+		worst = fmax(worst, fabs(remainder(analog_angle(sample(counts, 0)) - exact, 65536)));
+	}
+	CHECK(worst <= ANGLE_BOUND, "angle within %.2f of 65536 to a cycle, %.4f counts, %d allowed",
+	      worst, worst / 16384, ANGLE_BOUND);
+
+	// The count only has to be within 2 of the angle's cycle to pick it
+	worst = 0;
+	for(int i = 0; i < 400000; ++i)
+	{
+		double counts = 5000 + i * 0.0137;
+		uint16_t count = (uint16_t)(int64_t)floor(counts);
+		uint32_t position = analog_combine(analog_angle(sample(counts, 0)), count);
+		worst = fmax(worst, fabs((int32_t)(position - (uint32_t)llround(counts * 65536)) / 65536.0));
+	}
+	CHECK(worst <= COMBINE_BOUND, "position within %.4f counts, %.3f allowed", worst, COMBINE_BOUND);
+
+	// Ramped up to speed and held there, with noise on every reading and
+	// the counter read a little before or after the samples
+	static const double speeds[] = { 0.05, 1, 20, 100, 255, -50, -255 };
+	for(unsigned s = 0; s < sizeof(speeds) / sizeof(*speeds); ++s)
+	{
+		double counts = 1000;
+		uint32_t taken = 0;
+		double sample_time = 0;
+		int32_t velocity, acceleration;
+		worst = 0;
+		for(int tick = 0; tick < 400; ++tick)
+		{
+			double speed = speeds[s] * fmin(1, tick / 200.0);
+			for(sample_time += rate; taken < sample_time; ++taken)
+			{
+				counts += speed / rate;
+				history.analog[taken % HISTORY] = sample(counts, NOISE);
+			}
+			++ticks;
+			TIM3->CNT = (uint16_t)(int64_t)floor(counts + (rand() % 100 - 50) / 100.0 * speed / rate);
+			DMA1_Channel1->CNDTR = HISTORY - taken % HISTORY;
+			spindle_encoder_motion(&velocity, &acceleration);
+			if(tick > 300)
+				worst = fmax(worst, fabs(velocity / 65536.0 - speed));
+		}
+		CHECK(worst <= SPEED_BOUND, "%7.2f counts per ms measured to within %.4f, %.3f allowed",
+		      speeds[s], worst, SPEED_BOUND);
+	}
+
+	// What the angle and combine cost here, which only says so much about
+	// the controller, where diag gives the cycles
+	static uint32_t samples[4096];
+	for(int i = 0; i < 4096; ++i)
+		samples[i] = sample(i * 0.37, NOISE);
+	volatile uint32_t sink = 0;
+	double start = host_ns();
+	for(int repeat = 0; repeat < 2000; ++repeat)
+		for(int i = 0; i < 4096; ++i)
+			sink += analog_combine(analog_angle(samples[i]), i);
+	printf("     %.1fns a sample on the host\n", (host_ns() - start) / (2000.0 * 4096));
+
+	return check_result();
+}
@@ -0,0 +1,152 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the spindle encoder's count history: the least squares velocity
+// from the samples DMA takes, the position between counts it gives from
+// when the last counts came, and ratio_apply_fraction() that turns that
+// position into steps. The spindle is a simulated one that turns at a
+// steady speed, with the DMA and the counter following it.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "host.h"
+#include "ratio.h"
+#include "spindle_encoder.c"
+
+
+static double rate;           // samples per ms
+static double position;       // counts, exactly
+static double sample_time;    // samples that should have been taken by now
+static uint32_t taken;        // samples taken
+
+// One ms of the spindle turning at speed counts per ms, sampled into the
+// history as the ADC paces DMA1 channel 1
+static void run(double speed)
+{
+	sample_time += rate;
+	while(taken < sample_time)
+	{
+		position += speed / rate;
+		history.counts[taken % HISTORY] = (uint16_t)(int64_t)floor(position);
+		++taken;
+	}
+	DMA1_Channel1->CNDTR = HISTORY - taken % HISTORY;
+	TIM3->CNT = history.counts[(taken - 1) % HISTORY];
+	++ticks;
+}
+
+// The line through the same samples as worked out in doubles, in counts
+// per ms
+static double fit(void)
+{
+	double sum = 0;
+	uint32_t first = taken - WINDOW;
+	for(int k = 0; k < WINDOW; ++k)
+		sum += (2 * k - (WINDOW - 1)) * (double)(int16_t)(history.counts[(first + k) % HISTORY] - history.counts[first % HISTORY]);
+	return 2 * sum / SQUARES(WINDOW) * rate;
+}
+
+// The fixed point fit has to match the one in doubles. Against the true
+// speed it can only be as good as the counts allow, which is worst when a
+// single count comes in the middle of the window.
+static void velocity(double speed)
+{
+	int32_t measured, acceleration;
+	double worst_fit = 0;
+	double worst = 0;
+	for(int tick = 0; tick < 200; ++tick)
+	{
+		run(speed);
+		spindle_encoder_motion(&measured, &acceleration);
+		if(tick > SPAN)
+		{
+			worst_fit = fmax(worst_fit, fabs(measured / 65536.0 - fit()));
+			worst = fmax(worst, fabs(measured / 65536.0 - speed));
+		}
+	}
+	double one_count = 2.0 * (WINDOW / 2) * (WINDOW / 2) / SQUARES(WINDOW) * rate;
+	CHECK(worst_fit < 0.001 && worst < one_count,
+	      "%7.2f counts per ms measured to within %.4f, %.6f from the exact fit, %.2f for one count",
+	      speed, worst, worst_fit, one_count);
+}
+
+int main(void)
+{
+	spindle_encoder_init();
+	rate = samples_per_ms / 65536.0;
+	position = 30000.5;
+
+	// The velocity from a line through the last ms of counts, at speeds
+	// from well under a count a ms to the most the carriage can follow
+	velocity(0.3);
+	velocity(-1.3);
+	velocity(4.2);
+	velocity(-100);
+	velocity(255);
+
+	// Slowly enough for several ms between counts the position carries on
+	// between them, and never goes past the next count or backwards. The
+	// count is timed to a sample, and so is the time since, which allows
+	// two samples of travel.
+	double worst = 0;
+	double last = 0;
+	int backwards = 0;
+	for(int tick = 0; tick < 3000; ++tick)
+	{
+		run(0.3);
+		uint16_t count = TIM3->CNT;
+		double estimate = count + spindle_encoder_interpolate(count) / 65536.0;
+		double exact = position - 0.3 / rate;
+		if(tick > 100)
+		{
+			worst = fmax(worst, fabs(estimate - exact));
+			backwards += estimate < last;
+		}
+		last = estimate;
+	}
+	CHECK(worst < 2 * 0.3 / rate && backwards == 0,
+	      "0.3 counts per ms interpolated to within %.4f of a count, %.4f allowed, backwards %d times",
+	      worst, 2 * 0.3 / rate, backwards);
+
+	// The steps for a position with a fraction are exactly the floor of
+	// (position + fraction) * num / den, wrapping around as positions do
+	srand(1);
+	int wrong = 0;
+	for(int i = 0; i < 200000; ++i)
+	{
+		uint32_t count = rand() * 2u + (rand() & 1);
+		int32_t fraction = rand() % 131071 - 65535;
+		uint32_t num = rand() % 100000 + 1;
+		uint32_t den = rand() % 100000 + 1;
+		if(i & 1)
+		{
+			num = rand() * 3u;
+			den = RATIO_FIXED_ONE;
+		}
+		__int128 exact = ((__int128)count * 65536 + fraction) * num / ((__int128)den * 65536);
+		wrong += ratio_apply_fraction(count, fraction, num, den) != (uint32_t)exact;
+	}
+	CHECK(wrong == 0, "ratio_apply_fraction() wrong %d times in 200000", wrong);
+
+	return check_result();
+}
@@ -0,0 +1,128 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the frames serial.c sends for the telemetry: COBS leaves no zero
+// byte before the end of each, and the CRC is the one the STM32 CRC unit
+// gives. Given two files,
+//
+//   check <port> <expected>
+//
+// the frames are also written to the port and what they should decode to
+// to the other, which is what tools/loopback.py does through a pty.
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "host.h"
+#include "serial.c"
+#include "telemetry.h"
+
+
+static FILE* port = NULL;
+static FILE* expected = NULL;
+static uint32_t frames = 0;
+static uint32_t stray_zeros = 0;
+
+// Stands in for DMA1 channel 4 and USART1, sending the whole frame at
+// once. A frame to be corrupted has a byte changed on the way.
+static void transmit(uint16_t corrupt)
+{
+	uint16_t length = DMA1_Channel4->CNDTR;
+	if(length == 0)
+		return;
+	if(corrupt)
+		tx_buffer[corrupt] = tx_buffer[corrupt] == 0x55 ? 0xaa : 0x55;
+	for(uint16_t i = 0; i < length - 1; ++i)
+		stray_zeros += tx_buffer[i] == 0;
+	stray_zeros += tx_buffer[length - 1] != 0;
+	if(port)
+		fwrite(tx_buffer, 1, length, port);
+	++frames;
+
+	DMA1_Channel4->CNDTR = 0;
+	USART1->SR |= USART_SR_TC;
+}
+
+// The ring holds one less than its length, the rest are dropped
+static void sample(uint32_t tick, uint32_t position, int16_t steps, int16_t lag, uint8_t kept)
+{
+	telemetry_push(tick, position, steps, lag);
+	if(expected && kept)
+		fprintf(expected, "%u,%u,%d,%d\n", tick, position, steps, lag);
+}
+
+static void send(uint16_t corrupt)
+{
+	telemetry_update();
+	transmit(corrupt);
+}
+
+int main(int argc, char** argv)
+{
+	if(argc > 2)
+	{
+		port = fopen(argv[1], "wb");
+		expected = fopen(argv[2], "w");
+		if(!port || !expected)
+		{
+			perror("frames");
+			return 1;
+		}
+	}
+	USART1->SR = USART_SR_TC;
+
+	// The value the STM32 CRC unit gives for a single word
+	uint32_t word = 0x12345678;
+	serial_send(&word, 1);
+	CHECK(CRC->DR == 0xdf8a8a2b, "CRC of 0x%08x is 0x%08x", word, CRC->DR);
+	DMA1_Channel4->CNDTR = 0;
+	USART1->SR |= USART_SR_TC;
+
+	// Samples full of zero bytes
+	sample(0, 0, 0, 0, 1);
+	sample(0x100, 0x10000, 1, -1, 1);
+	sample(0x1000000, 0x7fffffff, 32767, -32768, 1);
+	send(0);
+
+	// More than the ring holds before they're sent, with none of the
+	// bytes zero so COBS has to break up the runs of 254
+	if(expected)
+		fprintf(expected, "# 9 samples dropped\n");
+	for(uint32_t i = 0; i < 40; ++i)
+		sample(0x01010101 + i, 0x80808080 + i, 0x0101 + i, -2 - i, i < 31);
+	send(0);
+	send(0);
+
+	// A corrupted frame is dropped, and the one after is still found
+	sample(5000, 5000, 5, 5, 0);
+	send(3);
+	if(expected)
+		fprintf(expected, "# bad frame\n");
+	sample(6000, 6000, 6, 6, 1);
+	send(0);
+
+	CHECK(stray_zeros == 0, "%u frames, %u zero bytes out of place", frames, stray_zeros);
+
+	if(port)
+		fclose(port);
+	if(expected)
+		fclose(expected);
+	return check_result();
+}
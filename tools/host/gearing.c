@@ -0,0 +1,107 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the hand over between the control loop making the steps and the
+// timers making them by themselves, for a ratio of a whole number of steps
+// to each cycle of the encoder's A input. The carriage has to stay with
+// the spindle through the hand over both ways, and let go of the gearing
+// when the spindle stops, turns back, or there's an armed stop to reach.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "host.h"
+#include "machine.h"
+
+#define main firmware_main
+#define _init firmware_init
+#include "main.c"
+#undef main
+
+
+#define STEPS_PER_COUNT  2
+
+static uint32_t spindle_start;
+static int32_t motor_start;
+static int32_t worst;
+
+// Steps the motor is short of where the spindle says it should be
+static int32_t error(void)
+{
+	return (int32_t)(machine_spindle - spindle_start) * STEPS_PER_COUNT - (machine_motor - motor_start);
+}
+
+static void run(int ticks, int32_t counts)
+{
+	for(int i = 0; i < ticks; ++i)
+	{
+		machine_spindle += counts;
+		SysTick_Handler();
+		if(abs(error()) > worst)
+			worst = abs(error());
+	}
+}
+
+int main(void)
+{
+	ratio.num = STEPS_PER_COUNT;
+	ratio.den = 1;
+	run(20, 0);
+	spindle_start = machine_spindle;
+	motor_start = machine_motor;
+
+	// 10 counts a ms is a 20 step train every 4 counts, plenty of time.
+	// The tick the gearing engages the carriage is left that tick behind,
+	// until the first train catches it up at the next cycle.
+	worst = 0;
+	run(5, 10);
+	int32_t engaging = worst;
+	worst = 0;
+	run(300, 10);
+	CHECK(gear_steps == 4 * STEPS_PER_COUNT && machine_gear == gear_steps && machine_gear_engages == 1 &&
+	      engaging <= 10 * STEPS_PER_COUNT && worst <= 2 * STEPS_PER_COUNT && fault == 0,
+	      "geared at %u steps a cycle, %d steps behind engaging and at most %d after",
+	      machine_gear, engaging, worst);
+
+	run(50, 0);
+	CHECK(machine_gear == 0 && error() == 0, "let go when stopped, %d steps out", error());
+
+	worst = 0;
+	run(5, -10);
+	engaging = worst;
+	worst = 0;
+	run(300, -10);
+	CHECK(machine_gear == gear_steps && machine_gear_engages == 2 &&
+	      engaging <= 10 * STEPS_PER_COUNT && worst <= 2 * STEPS_PER_COUNT,
+	      "geared again turning back, %d steps behind engaging and at most %d after", engaging, worst);
+
+	run(50, 0);
+	CHECK(machine_gear == 0 && error() == 0 && fault == 0, "let go when stopped, %d steps out", error());
+
+	stop_position = carriage_position + 1000000;
+	stop_armed = TRUE;
+	worst = 0;
+	run(300, 10);
+	CHECK(machine_gear == 0 && machine_gear_engages == 2 && worst <= 2 * STEPS_PER_COUNT,
+	      "left to the control loop with a stop armed, at most %d steps out", worst);
+
+	return check_result();
+}
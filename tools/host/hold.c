@@ -0,0 +1,113 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks a feed hold and resume while threading: the carriage brakes to a
+// stop and comes back exactly in phase with the spindle, as if it had
+// never stopped, with the speed only changing as fast as the encoder's
+// counts allow. That's with the spindle carrying on, and with it stopping
+// and turning back while held.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "host.h"
+#include "machine.h"
+
+#define main firmware_main
+#define _init firmware_init
+#include "main.c"
+#undef main
+
+
+#define THREAD_TABLE  1     // mm threads
+#define THREAD_INDEX  13    // 1mm
+#define STEPS_PER_TURN (1.0 * MOTION_STEPS_PER_MM)
+
+static int32_t last_move = 0;
+static int32_t hardest = 0;    // biggest change in steps from one tick to the next
+
+static void run(int ticks, int32_t counts)
+{
+	for(int i = 0; i < ticks; ++i)
+	{
+		int32_t before = carriage_position;
+		machine_spindle += counts;
+		SysTick_Handler();
+		int32_t moved = carriage_position - before;
+		if(abs(moved - last_move) > hardest)
+			hardest = abs(moved - last_move);
+		last_move = moved;
+	}
+}
+
+// Where the carriage is in the thread, in steps from where a continuous
+// cut would be, at one turn of the spindle per thread
+static double phase(void)
+{
+	double turns = (int32_t)machine_spindle / ENCODER_PULSES;
+	double phase = fmod(carriage_position - turns * STEPS_PER_TURN, STEPS_PER_TURN);
+	return phase < 0 ? phase + STEPS_PER_TURN : phase;
+}
+
+static double phase_error(double from)
+{
+	double error = fabs(phase() - from);
+	return fmin(error, STEPS_PER_TURN - error);
+}
+
+int main(void)
+{
+	// About 500 rpm
+	ratio = table_ratio(get_table(THREAD_TABLE), THREAD_INDEX);
+	run(200, 34);
+	double cutting = phase();
+
+	hardest = 0;
+	feed_hold = TRUE;
+	run(500, 34);
+	CHECK(last_move == 0 && fault == 0 && hardest <= 2,
+	      "held at 500 rpm, stopped with at most %d steps a tick of change", hardest);
+
+	hardest = 0;
+	feed_hold = FALSE;
+	int ticks = 0;
+	while(phase_error(cutting) >= 1 && ticks < 5000)
+	{
+		run(1, 34);
+		++ticks;
+	}
+	run(500, 34);
+	CHECK(phase_error(cutting) < 1 && fault == 0 && hardest <= 2,
+	      "resumed after %d ticks, %.2f steps out of phase, at most %d steps a tick of change",
+	      ticks, phase_error(cutting), hardest);
+
+	feed_hold = TRUE;
+	run(200, 34);
+	run(300, -15);
+	feed_hold = FALSE;
+	run(2000, 20);
+	CHECK(phase_error(cutting) < 1 && fault == 0,
+	      "held while the spindle stopped and turned back, %.2f steps out of phase once resumed",
+	      phase_error(cutting));
+
+	return check_result();
+}
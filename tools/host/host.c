@@ -0,0 +1,109 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The bits of the firmware the checks need from outside the code they
+// test, and reporting for them. Each check prints what it measured and
+// exits with an error if anything was out of bounds.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <stm32f103x6.h>
+
+#include "host.h"
+
+
+TIM_TypeDef host_tim1, host_tim2, host_tim3;
+AFIO_TypeDef host_afio;
+EXTI_TypeDef host_exti;
+GPIO_TypeDef host_gpioa, host_gpiob;
+ADC_TypeDef host_adc1, host_adc2;
+USART_TypeDef host_usart1;
+DMA_TypeDef host_dma1;
+DMA_Channel_TypeDef host_dma1_channel1, host_dma1_channel2, host_dma1_channel4;
+RCC_TypeDef host_rcc;
+FLASH_TypeDef host_flash;
+
+static CRC_TypeDef crc_unit;
+static uint32_t crc_sum = 0xffffffff;
+
+uint32_t SystemCoreClock = 72000000;
+volatile uint32_t ticks = 0;
+
+static int failures = 0;
+
+
+// A word the same as the sum so far would be missed, as it looks like
+// nothing was written, so the checks have to avoid writing one
+CRC_TypeDef* host_crc(void)
+{
+	if(crc_unit.CR & CRC_CR_RESET)
+	{
+		crc_sum = 0xffffffff;
+		crc_unit.CR &= ~CRC_CR_RESET;
+	}
+	else if(crc_unit.DR != crc_sum)
+	{
+		crc_sum ^= crc_unit.DR;
+		for(uint8_t bit = 0; bit < 32; ++bit)
+			crc_sum = crc_sum & 0x80000000 ? (crc_sum << 1) ^ 0x04c11db7 : crc_sum << 1;
+	}
+	crc_unit.DR = crc_sum;
+	return &crc_unit;
+}
+
+uint32_t get_cycles(void)
+{
+	return 0;
+}
+
+uint32_t get_ticks(void)
+{
+	return ticks;
+}
+
+// Prints the result of one check, and remembers if it failed
+void check(int passed, const char* condition, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	printf("%s ", passed ? "ok  " : "FAIL");
+	vprintf(format, args);
+	if(!passed)
+		printf(" (%s)", condition);
+	printf("\n");
+	va_end(args);
+	if(!passed)
+		++failures;
+}
+
+int check_result(void)
+{
+	return failures > 0 ? 1 : 0;
+}
+
+// Wall clock time in ns, for timing the code under test on the host
+double host_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
@@ -0,0 +1,12 @@
+
+// Shared by the host checks, see host.c
+
+#define CHECK(condition, ...) check((condition), #condition, __VA_ARGS__)
+
+extern uint32_t SystemCoreClock;
+extern volatile uint32_t ticks;
+uint32_t get_cycles(void);
+uint32_t get_ticks(void);
+void check(int passed, const char* condition, const char* format, ...);
+int check_result(void);
+double host_ns(void);
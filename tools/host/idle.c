@@ -0,0 +1,93 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks that the control loop going idle doesn't lose any spindle
+// counts. The spindle creeps on a count at a time, each after long
+// enough for the loop to idle and turn the servo off, and the carriage
+// has to end up exactly where following it continuously would have put
+// it. A servo alarm while idle then has to be acted on at once.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "host.h"
+#include "machine.h"
+
+#define main firmware_main
+#define _init firmware_init
+#include "main.c"
+#undef main
+
+
+#define THREAD_TABLE  1     // mm threads
+#define THREAD_INDEX  13    // 1mm
+
+static void run(int ticks, int32_t counts)
+{
+	for(int i = 0; i < ticks; ++i)
+	{
+		machine_spindle += counts;
+		SysTick_Handler();
+	}
+}
+
+int main(void)
+{
+	ratio = table_ratio(get_table(THREAD_TABLE), THREAD_INDEX);
+	run(10, 0);
+	uint32_t spindle_start = machine_spindle;
+	int32_t motor_start = machine_motor;
+
+	run(500, 34);
+	run(SPINDLE_IDLE_TIME * 2, 0);
+	uint8_t slept = !servo_is_enabled();
+
+	srand(1);
+	uint8_t woke = TRUE;
+	for(int creep = 0; creep < 200; ++creep)
+	{
+		run(SPINDLE_IDLE_TIME + rand() % (IDLE_TICK_INTERVAL * 4), 0);
+		slept &= !servo_is_enabled();
+		run(1, 1);
+		run(SERVO_ENABLE_TIME + 2, 0);
+		woke &= servo_is_enabled();
+	}
+
+	int64_t followed = (int64_t)(int32_t)(machine_spindle - spindle_start) * ratio.num / ratio.den;
+	int32_t error = (int32_t)(machine_motor - motor_start - followed);
+	CHECK(slept && woke, "servo turned off each time it idled, and back on for each count");
+	CHECK(error == 0 && fault == 0, "%d counts crept on a count at a time, carriage %d steps out",
+	      (int32_t)(machine_spindle - spindle_start), error);
+
+	// A servo alarm on a tick the idle loop would have skipped still
+	// stops the carriage there and then, and is in the black box
+	run(SPINDLE_IDLE_TIME * 2, 0);
+	while(ticks % IDLE_TICK_INTERVAL != IDLE_TICK_INTERVAL - 2)
+		run(1, 0);
+	machine_alarm = TRUE;
+	run(1, 0);
+	CHECK(fault == FAULT_SERVO_ALARM && blackbox_fault() == FAULT_SERVO_ALARM && blackbox_ticks() == ticks &&
+	      (blackbox_get(0)->flags & BLACKBOX_FLAG_ALARM),
+	      "alarm while idle faulted as %u, black box frozen with %u at tick %u of %u",
+	      fault, blackbox_fault(), blackbox_ticks(), ticks);
+
+	return check_result();
+}
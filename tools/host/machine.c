@@ -0,0 +1,163 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// A stand-in machine for the checks that run the control loop in main.c.
+// The drivers it talks to are replaced by a simple model here: a spindle
+// encoder that reads whatever machine_spindle is set to, and a servo that
+// makes every step asked for at once. The hardware gearing makes the
+// steps for each cycle of the A input as the spindle gets to it.
+
+#include <stdint.h>
+
+#include "host.h"
+#include "machine.h"
+#include "servo.h"
+
+
+uint32_t machine_spindle = 0;
+int32_t machine_motor = 0;
+uint8_t machine_clicks = 0;
+uint16_t machine_gear = 0;
+uint32_t machine_gear_engages = 0;
+uint8_t machine_alarm = 0;
+
+static uint8_t direction = 0;
+static uint8_t enabled = 1;
+static uint32_t gear_extra = 0;
+static uint32_t gear_cycle = 0;
+static int16_t knob = 0;
+
+
+void clock_init() {}
+void clock_start() {}
+uint8_t clock_get_source(void) { return 0; }
+uint32_t clock_boot_us(void) { return 0; }
+void delay_msec(int millis) {}
+
+void spindle_encoder_init() {}
+
+uint16_t spindle_encoder_get()
+{
+	return (uint16_t)machine_spindle;
+}
+
+uint8_t spindle_encoder_index(uint16_t* position)
+{
+	return 0;
+}
+
+// The speed over the last tick is near enough for the control loop
+void spindle_encoder_motion(int32_t* velocity, int32_t* acceleration)
+{
+	static uint32_t last_spindle = 0;
+	static int32_t last_velocity = 0;
+
+	*velocity = (int32_t)(machine_spindle - last_spindle) * 65536;
+	*acceleration = *velocity - last_velocity;
+	last_spindle = machine_spindle;
+	last_velocity = *velocity;
+}
+
+int32_t spindle_encoder_interpolate(uint16_t position)
+{
+	return 0;
+}
+
+uint32_t spindle_encoder_cycles()
+{
+	return 0;
+}
+
+void servo_init() {}
+uint8_t servo_is_idle() { return 1; }
+void servo_set_direction(uint8_t reverse) { direction = reverse; }
+void servo_enable(uint8_t enable) { enabled = enable; }
+uint8_t servo_is_enabled() { return enabled; }
+void servo_stop() {}
+uint8_t servo_alarm_get() { return machine_alarm; }
+int32_t servo_audit() { return 0; }
+
+void servo_step(uint8_t steps)
+{
+	machine_motor += direction ? -(int32_t)steps : steps;
+}
+
+void servo_audit_get(servo_audit_t* result)
+{
+	result->lost = 0;
+	result->extra = 0;
+	result->mismatches = 0;
+	result->reversals = 0;
+}
+
+void servo_gear(uint16_t pulses, uint8_t extra)
+{
+	if(pulses > 0 && machine_gear == 0)
+		++machine_gear_engages;
+	machine_gear = pulses;
+	gear_extra = extra;
+	gear_cycle = machine_spindle >> 2;
+}
+
+// Steps made by the gearing since last time, a train for every A cycle
+uint32_t servo_gear_steps()
+{
+	if(machine_gear == 0)
+		return 0;
+	uint32_t cycle = machine_spindle >> 2;
+	uint32_t cycles = cycle > gear_cycle ? cycle - gear_cycle : gear_cycle - cycle;
+	gear_cycle = cycle;
+	if(cycles == 0)
+		return 0;
+	uint32_t made = cycles * machine_gear + gear_extra;
+	gear_extra = 0;
+	machine_motor += direction ? -(int32_t)made : (int32_t)made;
+	return made;
+}
+
+void feedback_init() {}
+int32_t feedback_get() { return 0; }
+uint32_t feedback_missed() { return 0; }
+
+void display_init() {}
+void display_write(uint8_t reg, uint8_t value) {}
+
+void input_init() {}
+int16_t input_encoder_get() { return knob; }
+void input_encoder_set(int16_t value) { knob = value; }
+
+uint8_t input_button_get()
+{
+	uint8_t clicks = machine_clicks;
+	machine_clicks = 0;
+	return clicks;
+}
+
+void watchdog_init() {}
+__attribute__((weak)) void watchdog_checkin(uint8_t source) {}
+uint8_t watchdog_update() { return 1; }
+uint8_t watchdog_reset_cause() { return 0; }
+uint16_t watchdog_reset_count() { return 0; }
+
+// The serial port goes nowhere, unless a check brings serial.c with it
+__attribute__((weak)) void serial_init() {}
+__attribute__((weak)) uint8_t serial_is_busy() { return 0; }
+__attribute__((weak)) uint8_t serial_send(const uint32_t* words, uint8_t count) { return 1; }
+__attribute__((weak)) int16_t serial_read() { return -1; }
@@ -0,0 +1,9 @@
+
+// The stand-in machine for checks of the control loop, see machine.c
+
+extern uint32_t machine_spindle;       // encoder counts
+extern int32_t machine_motor;          // steps made, less those reversed
+extern uint8_t machine_clicks;         // button clicks for the panel to read
+extern uint16_t machine_gear;          // steps per A cycle being geared, or 0
+extern uint32_t machine_gear_engages;  // times gearing has been started
+extern uint8_t machine_alarm;          // the servo driver's alarm output
@@ -0,0 +1,98 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks pitch_comp_get() against the table worked out in floating point,
+// either side of the reference and after moving it, and times it at the
+// start and end of the table to show the cost doesn't grow along it.
+// Rounding to the nearest step is a little over half a step out at worst,
+// from the 16.16 fixed point.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "host.h"
+#include "compensation.c"
+
+
+static const double errors[] = PITCH_COMP_ERRORS;
+#define ENTRIES   (sizeof(errors) / sizeof(*errors))
+#define ROUNDING  0.51   // steps
+
+// Steps to add at a carriage position, with the reference at reference
+static double expected(int32_t position, int32_t reference)
+{
+	double mm = (position - reference) / STEPS_PER_MM - PITCH_COMP_START;
+	double at = mm / PITCH_COMP_SPACING;
+	double error;
+	if(at <= 0)
+		error = errors[0];
+	else if(at >= ENTRIES - 1)
+		error = errors[ENTRIES - 1];
+	else
+	{
+		int index = (int)at;
+		error = errors[index] + (errors[index + 1] - errors[index]) * (at - index);
+	}
+	return -error * STEPS_PER_MM / 1000;
+}
+
+static double worst_error(int32_t reference)
+{
+	double worst = 0;
+	for(int32_t position = -300 * STEPS_PER_MM; position < 300 * STEPS_PER_MM; position += 997)
+	{
+		double error = fabs(pitch_comp_get(position) - expected(position, reference));
+		if(error > worst)
+			worst = error;
+	}
+	return worst;
+}
+
+// Average ns for a call over a stretch of positions
+static double time_calls(int32_t from)
+{
+	volatile int32_t sink = 0;
+	double start = host_ns();
+	for(int repeat = 0; repeat < 100; ++repeat)
+		for(int32_t position = from; position < from + 100000; position += 7)
+			sink += pitch_comp_get(position);
+	return (host_ns() - start) / (100.0 * (100000 / 7 + 1));
+}
+
+int main(void)
+{
+	double worst = worst_error(0);
+	CHECK(worst <= ROUNDING, "reference at power on, worst %.3f steps from exact", worst);
+	CHECK(pitch_comp_get(-40 * STEPS_PER_MM) != pitch_comp_get(0),
+	      "compensated behind the power on position, %d steps at -40mm",
+	      pitch_comp_get(-40 * STEPS_PER_MM));
+
+	pitch_comp_set_reference(123456);
+	worst = worst_error(123456);
+	CHECK(worst <= ROUNDING, "reference moved, worst %.3f steps from exact", worst);
+
+	pitch_comp_set_reference(0);
+	double start = time_calls(-45 * STEPS_PER_MM);
+	double end = time_calls(70 * STEPS_PER_MM);
+	printf("     pitch_comp_get %.2f ns at the start of the table, %.2f at the end\n", start, end);
+
+	return check_result();
+}
@@ -0,0 +1,61 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The pty for the stand-in controller's serial port, apart from the
+// firmware as the terminal headers and the device header don't mix.
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "pty.h"
+
+
+// Opens a pty and prints the name of its far end, which is set up as a
+// raw serial port would be and kept open so the pty lasts from one
+// console to the next. Returns the non-blocking near end, or -1.
+int pty_open(void)
+{
+	int port = posix_openpt(O_RDWR | O_NOCTTY);
+	if(port < 0 || grantpt(port) < 0 || unlockpt(port) < 0)
+	{
+		perror("pty");
+		return -1;
+	}
+
+	int far = open(ptsname(port), O_RDWR | O_NOCTTY);
+	struct termios settings;
+	if(far < 0 || tcgetattr(far, &settings) < 0)
+	{
+		perror("pty");
+		return -1;
+	}
+	cfmakeraw(&settings);
+	tcsetattr(far, TCSANOW, &settings);
+	fcntl(port, F_SETFL, O_NONBLOCK);
+
+	printf("%s\n", ptsname(port));
+	fflush(stdout);
+	return port;
+}
@@ -0,0 +1,4 @@
+
+// See pty.c
+
+int pty_open(void);
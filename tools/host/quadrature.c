@@ -0,0 +1,162 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the servo driver's encoder feedback as decoded by feedback.c, and
+// the step pulse audit in servo.c, against a simulated motor. The motor
+// makes the steps that come out of TIM1, and its encoder's A and B edges
+// each run the EXTI handler. The pulses and the edges are then upset one
+// at a time: an edge missed, an edge back the other way, a step pulse lost
+// and one made without being asked for.
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "host.h"
+#include "feedback.c"
+#include "servo.c"
+
+
+#define MOTOR_STEPS_PER_COUNT ((int32_t)(STEPPER_PULSES / FEEDBACK_PULSES))
+
+static const uint8_t phases[4] = { 0, 1, 3, 2 };    // B << 1 | A, counting up
+static int32_t motor = 0;      // steps the motor has made
+static int32_t counts = 0;     // where its encoder is
+
+// The encoder's inputs now being at a count, with an edge for the handler
+static void edge(int32_t to)
+{
+	counts = to;
+	GPIOB->IDR = (uint32_t)phases[counts & 3] << 8;
+	EXTI9_5_IRQHandler();
+}
+
+// Steps made by the motor, with an edge for each count the encoder passes
+static void move(int32_t steps)
+{
+	int8_t direction = steps < 0 ? -1 : 1;
+	for(int32_t i = 0; i != steps; i += direction)
+	{
+		motor += direction;
+		int32_t at = motor >= 0 ? motor / MOTOR_STEPS_PER_COUNT : -((-motor + MOTOR_STEPS_PER_COUNT - 1) / MOTOR_STEPS_PER_COUNT);
+		if(at != counts)
+			edge(at);
+	}
+}
+
+// The channel's count goes down by one for each pulse, see pulse_count.c
+static void pulses(uint32_t count)
+{
+	for(uint32_t i = 0; i < count; ++i)
+		DMA1_Channel2->CNDTR = DMA1_Channel2->CNDTR == 1 ? PULSE_COUNTER : DMA1_Channel2->CNDTR - 1;
+}
+
+// A train of steps, with made of them coming out and reaching the motor
+static void train(uint8_t steps, int32_t made, uint8_t reverse)
+{
+	servo_set_direction(reverse);
+	servo_step(steps);
+	pulses(made);
+	TIM1->CR1 &= ~TIM_CR1_CEN;
+	move(reverse ? -made : made);
+}
+
+int main(void)
+{
+	// feedback_init() would set up the NVIC, which isn't there, and all
+	// it leaves behind is the state of the inputs
+	servo_init();
+	GPIOB->IDR = 0;
+	last_state = 0;
+	// The pulses servo_init() makes itself, for the repeat count of 1
+	pulses(2);
+	TIM1->CR1 &= ~TIM_CR1_CEN;
+
+	// Forwards and back, all as asked
+	int32_t wrong = 0;
+	for(int i = 0; i < 1000; ++i)
+	{
+		train(200, 200, 0);
+		wrong += servo_audit() != 0;
+	}
+	for(int i = 0; i < 700; ++i)
+	{
+		train(200, 200, 1);
+		wrong += servo_audit() != 0;
+	}
+	CHECK(wrong == 0 && feedback_get() == motor && motor == 60000 && feedback_missed() == 0,
+	      "%d steps, fed back as %d with %u edges missed, %d trains miscounted",
+	      motor, feedback_get(), feedback_missed(), wrong);
+
+	// An edge that came too soon after the last to be seen: the inputs go
+	// straight to two counts on, which the decoder can't give a direction
+	// to, so it's counted as missed and the position falls behind
+	counts += 2;
+	motor += 2 * MOTOR_STEPS_PER_COUNT;
+	GPIOB->IDR = (uint32_t)phases[counts & 3] << 8;
+	EXTI9_5_IRQHandler();
+	CHECK(feedback_missed() == 1 && motor - feedback_get() == 2 * MOTOR_STEPS_PER_COUNT,
+	      "skipped state counted as %u missed, fed back %d steps short",
+	      feedback_missed(), motor - feedback_get());
+	int32_t behind = motor - feedback_get();
+
+	// The motor knocked back a count against the way it was going is
+	// followed, as a count the other way rather than a missed one
+	edge(counts - 1);
+	motor -= MOTOR_STEPS_PER_COUNT;
+	edge(counts + 1);
+	motor += MOTOR_STEPS_PER_COUNT;
+	CHECK(feedback_missed() == 1 && motor - feedback_get() == behind,
+	      "knocked back and forward again, still %d steps short and %u missed", motor - feedback_get(),
+	      feedback_missed());
+
+	// A pulse lost between TIM1 and the driver
+	train(100, 99, 0);
+	int32_t lost = servo_audit();
+
+	// And one the driver saw that nothing asked for
+	pulses(1);
+	move(1);
+	train(100, 100, 0);
+	int32_t extra = servo_audit();
+
+	servo_audit_t audit;
+	servo_audit_get(&audit);
+	CHECK(lost == -1 && extra == 1 && audit.lost == 1 && audit.extra == 1 && audit.mismatches == 2,
+	      "lost pulse audited as %d, extra as %d, %u lost and %u extra in all",
+	      lost, extra, audit.lost, audit.extra);
+
+	// What an edge costs here, which only says so much about the
+	// controller, where the handler's cycles set how fast the motor can
+	// turn before edges are missed
+	uint32_t missed = feedback_missed();
+	double start = host_ns();
+	for(int repeat = 0; repeat < 1000; ++repeat)
+	{
+		for(int i = 0; i < 4000; ++i)
+			edge(counts + 1);
+		for(int i = 0; i < 4000; ++i)
+			edge(counts - 1);
+	}
+	double ns = (host_ns() - start) / (1000.0 * 8000);
+	CHECK(feedback_missed() == missed, "%u edges missed when timed", feedback_missed() - missed);
+	printf("     %.1fns an edge on the host\n", ns);
+
+	return check_result();
+}
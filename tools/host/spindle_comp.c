@@ -0,0 +1,104 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks that the spindle encoder's error within each turn can be learned
+// and taken out again. The simulated encoder is mounted off centre, which
+// makes a 3 count error once a turn, with a smaller one twice a turn from
+// the coupling, and the spindle's speed wanders a little as it turns.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "host.h"
+#include "compensation.c"
+
+
+#define ECCENTRICITY  3.0     // counts, once a turn
+#define COUPLING      0.5     // counts, twice a turn
+#define PHASE         0.7     // radians of the eccentricity from the index
+#define RPM           120.0
+#define TURNS         10
+
+// What the encoder reads, in turns, for the spindle at angle turns
+static double reading(double angle)
+{
+	return angle + ECCENTRICITY / ENCODER_PULSES * sin(2 * M_PI * angle + PHASE) +
+	       COUPLING / ENCODER_PULSES * sin(4 * M_PI * angle);
+}
+
+// The spindle's angle for a reading, the other way round
+static double truth(double read)
+{
+	double angle = read;
+	for(int i = 0; i < 20; ++i)
+		angle = read - (reading(angle) - angle);
+	return angle;
+}
+
+int main(void)
+{
+	// Learned as main.c does it, a tick at a time from the whole counts
+	// since the index
+	spindle_comp_start(TURNS);
+	double angle = 0.3;
+	double last = reading(angle);
+	uint32_t time;
+	for(time = 1; time < 200000 && spindle_comp_update(); ++time)
+	{
+		double speed = RPM / 60000 * (1 + 0.001 * sin(time * 0.0003));    // turns per ms
+		angle += speed;
+		double read = reading(angle);
+		uint8_t index = floor(read) != floor(last);
+		uint32_t counts = (read - floor(read)) * ENCODER_PULSES;
+		spindle_comp_learn(time, counts * 65536, speed * ENCODER_PULSES * 65536, index);
+		last = read;
+	}
+
+	// Measured minus true angle in arc seconds at each entry
+	double worst = 0;
+	double largest = 0;
+	for(int i = 0; i < SPINDLE_COMP_BINS; ++i)
+	{
+		double read = (double)i / SPINDLE_COMP_BINS;
+		double error = (read - truth(read)) * ARCSEC_PER_TURN;
+		worst = fmax(worst, fabs(spindle_comp_error(i) - error));
+		largest = fmax(largest, fabs(error));
+	}
+	CHECK(worst < 20, "learned in %u ms, table within %.1f arc seconds of the %.0f error, a count is %.0f",
+	      time, worst, largest, ARCSEC_PER_TURN / ENCODER_PULSES);
+
+	// Corrected with the table, the angle is close to true all the way
+	// round, in between the entries as well as at them
+	double before = 0;
+	double after = 0;
+	for(int i = 0; i < 4096; ++i)
+	{
+		double read = (i + 0.5) / 4096;
+		double exact = truth(read) * ENCODER_PULSES;
+		uint32_t position = read * ENCODER_PULSES * 65536;
+		double corrected = ((int64_t)position + spindle_comp_get(position)) / 65536.0;
+		before = fmax(before, fabs(read * ENCODER_PULSES - exact));
+		after = fmax(after, fabs(remainder(corrected - exact, ENCODER_PULSES)));
+	}
+	CHECK(after < 0.1, "corrected to within %.3f of a count from %.3f", after, before);
+
+	return check_result();
+}
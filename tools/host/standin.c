@@ -0,0 +1,113 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// A stand-in controller to try the serial console against, or to script
+// tests of it from the PC. The firmware's control loop and main loop run
+// in real time with the stand-in machine, and serial.c talks to a pty.
+//
+//   standin [rpm]
+//
+// prints the name of the pty for tools/console.py and runs until it's
+// killed, with the spindle turning at the given speed. Telemetry starts
+// off so as not to fill the pty when nothing's reading it.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host.h"
+#include "machine.h"
+#include "pty.h"
+
+#define main firmware_main
+#define _init firmware_init
+#include "main.c"
+#undef main
+#include "serial.c"
+
+
+static int port = -1;
+
+// DMA1 channel 4 sends the frame in one go, or it's lost if the pty is
+// full up, which is what happens with nothing on the other end
+static void transmit(void)
+{
+	if(DMA1_Channel4->CNDTR == 0)
+		return;
+	if(write(port, tx_buffer, DMA1_Channel4->CNDTR) < 0)
+		;
+	DMA1_Channel4->CNDTR = 0;
+	USART1->SR |= USART_SR_TC;
+}
+
+static void receive(void)
+{
+	uint8_t byte;
+	while(read(port, &byte, 1) == 1)
+	{
+		USART1->SR |= USART_SR_RXNE;
+		USART1->DR = byte;
+		USART1_IRQHandler();
+	}
+}
+
+// The firmware checks in while it waits for the serial port, which is
+// where the frame it's waiting on gets sent
+void watchdog_checkin(uint8_t source)
+{
+	transmit();
+}
+
+int main(int argc, char** argv)
+{
+	double rpm = argc > 1 ? atof(argv[1]) : 0;
+
+	port = pty_open();
+	if(port < 0)
+		return 1;
+
+	USART1->SR = USART_SR_TC;
+	telemetry_enable(FALSE);
+
+	double spindle = 0;
+	struct timespec tick = { 0, 1000000 };
+	for(uint32_t ms = 0; ; ++ms)
+	{
+		spindle += rpm * ENCODER_PULSES / 60000;
+		machine_spindle = (uint32_t)(int64_t)spindle;
+		SysTick_Handler();
+
+		// The main loop every 10ms, as it runs on the controller
+		if(ms % 10 == 0)
+		{
+			receive();
+			ui_update();
+			char* line = console_read_line();
+			if(line)
+				console_command(line);
+			telemetry_update();
+			spindle_comp_update();
+		}
+		transmit();
+		nanosleep(&tick, NULL);
+	}
+}
@@ -0,0 +1,71 @@
+// Stand-in for the device header when the firmware is built on the host
+// for the checks. Everything is the same except that the peripherals are
+// plain structs in host.c, rather than registers at fixed addresses, so
+// a check can set them up and see what the firmware did with them.
+
+#ifndef HOST_STM32F103X6_H
+#define HOST_STM32F103X6_H
+
+// Interrupts can't be turned off on the host, and there's nothing to
+// turn off as the checks run everything from one thread
+#define __disable_irq   host_cmsis_disable_irq
+#define __enable_irq    host_cmsis_enable_irq
+#include "../../stm32/stm32f103x6.h"
+#undef __disable_irq
+#undef __enable_irq
+#define __disable_irq() ((void)0)
+#define __enable_irq()  ((void)0)
+
+#undef TIM1
+#undef TIM2
+#undef TIM3
+#undef AFIO
+#undef EXTI
+#undef GPIOA
+#undef GPIOB
+#undef ADC1
+#undef ADC2
+#undef USART1
+#undef DMA1
+#undef DMA1_Channel1
+#undef DMA1_Channel2
+#undef DMA1_Channel4
+#undef RCC
+#undef FLASH
+#undef CRC
+
+extern TIM_TypeDef host_tim1, host_tim2, host_tim3;
+extern AFIO_TypeDef host_afio;
+extern EXTI_TypeDef host_exti;
+extern GPIO_TypeDef host_gpioa, host_gpiob;
+extern ADC_TypeDef host_adc1, host_adc2;
+extern USART_TypeDef host_usart1;
+extern DMA_TypeDef host_dma1;
+extern DMA_Channel_TypeDef host_dma1_channel1, host_dma1_channel2, host_dma1_channel4;
+extern RCC_TypeDef host_rcc;
+extern FLASH_TypeDef host_flash;
+
+#define TIM1            (&host_tim1)
+#define TIM2            (&host_tim2)
+#define TIM3            (&host_tim3)
+#define AFIO            (&host_afio)
+#define EXTI            (&host_exti)
+#define GPIOA           (&host_gpioa)
+#define GPIOB           (&host_gpiob)
+#define ADC1            (&host_adc1)
+#define ADC2            (&host_adc2)
+#define USART1          (&host_usart1)
+#define DMA1            (&host_dma1)
+#define DMA1_Channel1   (&host_dma1_channel1)
+#define DMA1_Channel2   (&host_dma1_channel2)
+#define DMA1_Channel4   (&host_dma1_channel4)
+#define RCC             (&host_rcc)
+#define FLASH           (&host_flash)
+
+// The CRC unit works a word into the sum each time one's written to it,
+// which a struct can't do by itself. Instead every use of it goes through
+// host_crc(), which catches up with whatever was written since the last.
+CRC_TypeDef* host_crc(void);
+#define CRC             (host_crc())
+
+#endif
@@ -0,0 +1,101 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the speed profiles in motion.c: a move comes to rest exactly on
+// its target without braking harder than ACCELERATION, and neither kind
+// of profile asks for more steps than the step timer can make in a tick.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "host.h"
+#include "motion.c"
+
+
+// Runs a move of distance steps, returning the ticks it took and the most
+// steps in a tick, the biggest drop in steps from one tick to the next,
+// and how far it ended up from the target
+static uint32_t move(int32_t distance, uint32_t max_speed, uint32_t* fastest,
+                     uint32_t* hardest, int32_t* miss)
+{
+	motion_t motion;
+	motion_reset(&motion);
+	int32_t position = 0;
+	uint32_t last = 0;
+	uint32_t ticks = 0;
+	*fastest = 0;
+	*hardest = 0;
+	while(position != distance && ticks < 1000000)
+	{
+		int32_t steps = motion_update(&motion, distance - position, max_speed);
+		uint32_t size = steps < 0 ? 0 - steps : steps;
+		if(size > *fastest)
+			*fastest = size;
+		if(last > size && last - size > *hardest)
+			*hardest = last - size;
+		last = size;
+		position += steps;
+		++ticks;
+	}
+	*miss = distance - position;
+	return ticks;
+}
+
+int main(void)
+{
+	double rate = accel / 65536.0;    // steps per tick per tick
+	uint32_t fastest, hardest;
+	int32_t miss;
+
+	static const double speeds[] = { 2.0, RAPID_SPEED, 50.0 };   // mm/s
+	static const int32_t distances[] = { 3, 800, 40000, -250000 };
+	for(int i = 0; i < 3; ++i)
+	{
+		for(int j = 0; j < 4; ++j)
+		{
+			int32_t distance = distances[j];
+			uint32_t ticks = move(distance, MOTION_SPEED(speeds[i]), &fastest, &hardest, &miss);
+
+			// An ideal trapezoid, or triangle if it's too short to get up
+			// to speed, to compare with
+			double top = fmin(MOTION_SPEED(speeds[i]) / 65536.0, STEP_RATE_MAX);
+			double length = fabs(distance);
+			double ideal = length > top * top / rate ? length / top + top / rate :
+			                                            2 * sqrt(length / rate);
+
+			CHECK(miss == 0 && fastest <= STEP_RATE_MAX && hardest <= ceil(rate) + 1 &&
+			      ticks <= ideal * 1.05 + 4,
+			      "%4.1f mm/s over %7d steps: %u ticks for %.0f ideal, %u steps a tick at most, "
+			      "braking %u, missed by %d",
+			      speeds[i], distance, ticks, ideal, fastest, hardest, miss);
+		}
+	}
+
+	motion_t motion;
+	motion_reset(&motion);
+	int32_t steps = 0;
+	for(int tick = 0; tick < 1000; ++tick)
+		steps = motion_run(&motion, -(int32_t)MOTION_SPEED(50.0));
+	CHECK(steps == -STEP_RATE_MAX,
+	      "steady run asked for 50 mm/s makes %d steps a tick", steps);
+
+	return check_result();
+}
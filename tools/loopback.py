@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+#
+#   Copyright (C) 2023 Stephen Robinson
+#
+#   This file is part of Sieg SC4 ELS
+#
+#   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   Sieg SC4 ELS is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this code (see the file names COPING).
+#   If not, see <http://www.gnu.org/licenses/>.
+#
+# Checks the telemetry framing end to end: the host build of serial.c and
+# telemetry.c from tools/host sends its frames through a pseudo terminal,
+# as the controller would through the USB serial adapter, and they're
+# decoded here the way telemetry.py does it.
+#
+#   make -C tools/host frames
+#   tools/loopback.py tools/host/build/frames/check
+
+import io
+import os
+import select
+import subprocess
+import sys
+import tempfile
+import tty
+
+from telemetry import FRAME_TELEMETRY, crc32_stm32, decode_frame, frames, samples
+
+
+def receive(check):
+    master, slave = os.openpty()
+    tty.setraw(slave)
+    received = bytearray()
+    with tempfile.NamedTemporaryFile("r") as expected:
+        process = subprocess.Popen([check, os.ttyname(slave), expected.name],
+                                   stdout=subprocess.DEVNULL)
+        while True:
+            readable, _, _ = select.select([master], [], [], 0.1)
+            if readable:
+                received += os.read(master, 256)
+            elif process.poll() is not None:
+                break
+        os.close(slave)
+        os.close(master)
+        if process.returncode != 0:
+            sys.exit("%s failed" % check)
+        return bytes(received), expected.read().splitlines()
+
+
+def decode(received):
+    lines = []
+    for encoded in frames(io.BytesIO(received)):
+        try:
+            words = decode_frame(encoded)
+        except ValueError:
+            lines.append("# bad frame")
+            continue
+        if words[0] & 0xff != FRAME_TELEMETRY:
+            continue
+        dropped, rows = samples(words)
+        if dropped:
+            lines.append("# %d samples dropped" % dropped)
+        lines += ["%d,%d,%d,%d" % row for row in rows]
+    return lines
+
+
+def main():
+    check = sys.argv[1] if len(sys.argv) > 1 else "tools/host/build/frames/check"
+    failed = False
+
+    crc = crc32_stm32([0x12345678])
+    failed |= crc != 0xdf8a8a2b
+    print("%s CRC of 0x12345678 is 0x%08x" % ("FAIL" if crc != 0xdf8a8a2b else "ok  ", crc))
+
+    received, expected = receive(check)
+    lines = decode(received)
+    failed |= lines != expected
+    print("%s %d bytes through the pty decode to %d of %d lines" % (
+        "FAIL" if lines != expected else "ok  ", len(received),
+        sum(a == b for a, b in zip(lines, expected)), len(expected)))
+    if lines != expected:
+        for line in lines:
+            print("     %s" % line)
+
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+#
+#   Copyright (C) 2023 Stephen Robinson
+#
+#   This file is part of Sieg SC4 ELS
+#
+#   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   Sieg SC4 ELS is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this code (see the file names COPING).
+#   If not, see <http://www.gnu.org/licenses/>.
+#
+# Reports where the RAM goes from the linker map, run by make size:
+#
+#   tools/ram.py main.map
+#
+# Lists each section in RAM, what's left over, and the biggest things in
+# it so that it's easy to see what a change has cost. Fails if there isn't
+# room for the heap and stack the linker script asks for on top of the
+# data, bss and code run from RAM, as with PROFILE=fast that's close.
+
+import re
+import sys
+
+RAM_START = 0x20000000
+RAM_SIZE = 10 * 1024
+BIGGEST = 10
+
+SECTION = re.compile(r"^(\.\S+|\*\S+)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)(?:\s+(.*))?$")
+SYMBOL = re.compile(r"^\s+0x([0-9a-f]+)\s+(\w+) = ")
+
+# Set by the linker script, and room for them checked by ._user_heap_stack
+HEAP_STACK = ("_Min_Heap_Size", "_Min_Stack_Size")
+
+
+def in_ram(address):
+    return RAM_START <= address < RAM_START + RAM_SIZE
+
+
+def read_map(path):
+    sections = []
+    pieces = []
+    output = None
+    pending = None
+    started = False
+    symbols = {}
+    for line in open(path):
+        line = line.rstrip("\n")
+        symbol = SYMBOL.match(line)
+        if symbol:
+            symbols[symbol.group(2)] = int(symbol.group(1), 16)
+            continue
+        if line.startswith("Linker script and memory map"):
+            started = True
+            continue
+        if not started:
+            continue
+
+        # Long names go on a line of their own, with the rest on the next
+        if re.match(r"^ ?\.\S+$", line):
+            pending = line
+            continue
+        if pending is not None:
+            line = pending + line
+            pending = None
+
+        match = SECTION.match(line.strip() if line.startswith(" ") else line)
+        if not match or match.group(1) is None:
+            continue
+        name, address, size = match.group(1), int(match.group(2), 16), int(match.group(3), 16)
+        if not line.startswith(" "):
+            output = name if in_ram(address) else None
+            if output is not None and size > 0:
+                sections.append((name, address, size))
+        elif output is not None and size > 0 and match.group(4):
+            source = match.group(4).split("load address")[0].strip()
+            pieces.append((size, name, source, output))
+    return sections, pieces, symbols
+
+
+def main():
+    path = sys.argv[1] if len(sys.argv) > 1 else "main.map"
+    sections, pieces, symbols = read_map(path)
+
+    used = 0
+    print("RAM budget, %d bytes" % RAM_SIZE)
+    for name, address, size in sections:
+        # The heap and stack are counted from what's asked for below
+        if name == "._user_heap_stack":
+            continue
+        print("  %-20s 0x%08x %6d" % (name, address, size))
+        used += size
+    ramfunc = sum(size for size, name, _, _ in pieces if name.startswith(".ramfunc"))
+    if ramfunc:
+        print("  %-20s %10s %6d  (in .data)" % (".ramfunc", "", ramfunc))
+    reserved = 0
+    for name in HEAP_STACK:
+        if name not in symbols:
+            sys.exit("error: %s isn't in %s" % (name, path))
+        print("  %-20s %10s %6d" % (name, "", symbols[name]))
+        reserved += symbols[name]
+    free = RAM_SIZE - used - reserved
+    print("  %-20s %10s %6d" % ("free", "", free))
+
+    print("biggest in RAM")
+    for size, name, source, output in sorted(pieces, reverse=True)[:BIGGEST]:
+        print("  %6d  %-30s %s" % (size, name, source))
+
+    if free < 0:
+        sys.exit("error: RAM is %d bytes short of the heap and stack" % -free)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+#
+#   Copyright (C) 2023 Stephen Robinson
+#
+#   This file is part of Sieg SC4 ELS
+#
+#   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   Sieg SC4 ELS is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this code (see the file names COPING).
+#   If not, see <http://www.gnu.org/licenses/>.
+#
+# Runs the stand-in controller from tools/host, the firmware built for the
+# PC with its serial port on a pty, to try the console without a lathe:
+#
+#   make -C tools/host standin
+#   tools/standin.py tools/host/build/standin/check [rpm]
+#   tools/console.py /dev/pts/N      (in another terminal)
+#
+# With --check it sends a script of commands instead and checks what comes
+# back, which is how make host runs it.
+
+import os
+import re
+import select
+import subprocess
+import sys
+
+from console import reply
+from telemetry import decode_frame
+
+# Each command and what the lines back should match, in order
+SCRIPT = [
+    ("pitch 1", [r"ok 125/64 error 0 ppb, 832 rpm max"]),
+    ("pitch -1.5", [r"ok 375/128 error 0 ppb, 555 rpm max"]),
+    ("tpi 20", [r"ok 635/256 error 0 ppb, 655 rpm max"]),
+    ("pitch 10", [r"error: pitch too coarse, 83 rpm max"]),
+    ("pitch 5000000", [r"error: bad number"]),
+    ("pitch 2147484", [r"error: bad number"]),
+    ("pitch x", [r"error: bad number"]),
+    ("pitch 0", [r"error: pitch out of range"]),
+    ("pitch 2147483.647", [r"error: pitch too coarse, 0 rpm max"]),
+    ("set rapid 50", [r"clamped to 13\.875, 111 steps per ms",
+                      r"backlash 0\.000 accel 100 rapid 13\.875 jog 10\.000"]),
+    ("set jog 5", [r"backlash 0\.000 accel 100 rapid 13\.875 jog 5\.000"]),
+    ("set jog 13.875", [r"backlash 0\.000 accel 100 rapid 13\.875 jog 13\.875"]),
+    ("set jog -5", [r"error: value out of range"]),
+    ("set jog x", [r"error: bad number"]),
+    ("set feed 5", [r"error: bad parameter"]),
+    ("set jog 13.876", [r"clamped to 13\.875, 111 steps per ms", r".* jog 13\.875"]),
+]
+
+
+def lines(port, wait):
+    # Console lines until nothing more comes for the given time
+    buffer = bytearray()
+    result = []
+    while select.select([port], [], [], wait)[0]:
+        for byte in os.read(port, 256):
+            if byte != 0:
+                buffer.append(byte)
+                continue
+            try:
+                text = reply(decode_frame(bytes(buffer)))
+            except ValueError as e:
+                text = "# %s" % e
+            buffer.clear()
+            if text is not None:
+                result.append(text)
+    return result
+
+
+def check(path):
+    port = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    lines(port, 0.2)
+    failed = False
+    for command, expected in SCRIPT:
+        os.write(port, command.encode() + b"\n")
+        got = lines(port, 0.2)
+        passed = len(got) == len(expected) and all(
+            re.fullmatch(pattern, line) for pattern, line in zip(expected, got))
+        print("%s %-18s %s" % ("ok  " if passed else "FAIL", command, " | ".join(got)))
+        failed |= not passed
+    os.close(port)
+    return failed
+
+
+def main():
+    args = [a for a in sys.argv[1:] if a != "--check"]
+    program = args[0] if args else "tools/host/build/standin/check"
+    standin = subprocess.Popen([program] + args[1:], stdout=subprocess.PIPE, text=True)
+    path = standin.stdout.readline().strip()
+    try:
+        if "--check" in sys.argv:
+            sys.exit(1 if check(path) else 0)
+        print("console on %s, Ctrl-C to stop" % path)
+        standin.wait()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        standin.kill()
+
+
+if __name__ == "__main__":
+    main()
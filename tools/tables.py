@@ -0,0 +1,286 @@
+#!/usr/bin/env python3
+#
+#   Copyright (C) 2023 Stephen Robinson
+#
+#   This file is part of Sieg SC4 ELS
+#
+#   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   Sieg SC4 ELS is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this code (see the file names COPING).
+#   If not, see <http://www.gnu.org/licenses/>.
+#
+# Generates tables.h from the pitch list and the machine in config.h, run
+# by the Makefile whenever either changes:
+#
+#   tools/tables.py pitches.txt config.h tables.h
+#
+# Every ratio is worked out exactly as a fraction and only rounded if it
+# has to be, the display digits come from the pitch itself, and a report
+# of the error and the fastest the spindle can turn for each entry is
+# printed, with the steps per encoder cycle for those that can be geared
+# in hardware.
+
+import re
+import sys
+from decimal import Decimal
+from fractions import Fraction
+
+# Limits of the step output, keep these in step with the firmware
+MAX_STEPS_PER_TICK = 255    # main.c, per 1ms control loop tick
+STEP_PERIOD_US = 9          # servo.h, TIM1 ARR + 1 at 1MHz
+MAX_STEP_RATE = min(MAX_STEPS_PER_TICK, 1000 // STEP_PERIOD_US)
+
+RATIO_FIXED_ONE = 65536
+GEAR_COUNTS = 4             # ratio.h, encoder counts for each cycle of its A input
+GEAR_MAX = 256              # ratio.h, steps TIM1 can make from one trigger
+UINT16_MAX = 0xffff
+UINT32_MAX = 0xffffffff
+INCH = Fraction(254, 10)
+
+# kind: (screw, what a value is in mm, units for the report)
+KINDS = {
+    "thread": ("LEADSCREW_PITCH", lambda v: v, "mm"),
+    "feed": ("FEEDSCREW_PITCH", lambda v: v, "mm"),
+    "tpi": ("LEADSCREW_PITCH", lambda v: INCH / v, "tpi"),
+    "thou": ("FEEDSCREW_PITCH", lambda v: v * INCH / 1000, "thou"),
+    "jog": ("LEADSCREW_PITCH", lambda v: v, "mm"),
+    "feed_rate": ("FEEDSCREW_PITCH", lambda v: v, "mm/min"),
+}
+
+
+class TableError(Exception):
+    pass
+
+
+def read_config(path):
+    # Just enough of the preprocessor for the numbers in config.h, worked
+    # out as fractions so that nothing is lost along the way
+    names = {}
+    for line in open(path):
+        match = re.match(r"\s*#define\s+(\w+)\s+(.*?)\s*(//.*)?$", line)
+        if not match:
+            continue
+        expression = re.sub(r"\b\d+\.\d*|\b\d+\b",
+                            lambda m: "Fraction('%s')" % m.group(0).rstrip("."),
+                            match.group(2))
+        try:
+            names[match.group(1)] = eval(expression, {"Fraction": Fraction}, dict(names))
+        except Exception:
+            pass
+    return names
+
+
+def read_pitches(path):
+    tables = []
+    for number, line in enumerate(open(path), 1):
+        words = line.split("#")[0].split()
+        if not words:
+            continue
+        where = "%s:%d" % (path, number)
+        if words[0] == "table":
+            if len(words) not in (4, 5) or words[2] not in KINDS or \
+               (len(words) == 5 and words[4] != "zero"):
+                raise TableError("%s: expected table <name> <kind> <decimals> [zero]" % where)
+            tables.append({
+                "name": words[1],
+                "kind": words[2],
+                "decimals": int(words[3]),
+                "zero": len(words) == 5,
+                "values": [],
+            })
+        elif not tables:
+            raise TableError("%s: values before the first table" % where)
+        else:
+            tables[-1]["values"] += [(word, where) for word in words]
+    return tables
+
+
+def shown(value, decimals, where):
+    # The value as the three digits on the display, without the point.
+    # The firmware puts the point in from the table's decimals.
+    scaled = Decimal(value).scaleb(decimals)
+    if scaled != scaled.to_integral_value() or scaled < 0:
+        raise TableError("%s: %s has more than %d decimals" % (where, value, decimals))
+    if scaled >= 1000:
+        raise TableError("%s: %s doesn't fit on the display" % (where, value))
+    return int(scaled)
+
+
+def approximate(value):
+    # The closest fraction that fits in a table entry, the same as
+    # ratio_approximate() in ratio.c but with a 16 bit bottom
+    if value.numerator <= UINT32_MAX and value.denominator <= UINT16_MAX:
+        return value
+    p0, q0, p1, q1 = 0, 1, 1, 0
+    n, d = value.numerator, value.denominator
+    while d:
+        a = n // d
+        k = a
+        if p1:
+            k = min(k, (UINT32_MAX - p0) // p1)
+        if q1:
+            k = min(k, (UINT16_MAX - q0) // q1)
+        if k < a:
+            if k * 2 > a:
+                p1, q1 = k * p1 + p0, k * q1 + q0
+            break
+        p0, q0, p1, q1 = p1, q1, a * p1 + p0, a * q1 + q0
+        n, d = d, n - a * d
+    return Fraction(p1, q1)
+
+
+def entry(table, value, where, machine):
+    screw, to_mm, _ = KINDS[table["kind"]]
+    steps_per_mm = machine["DRIVE_RATIO"] * machine["STEPPER_PULSES"] / machine[screw]
+    mm = to_mm(Fraction(Decimal(value)))
+    if mm <= 0:
+        raise TableError("%s: %s isn't a pitch" % (where, value))
+
+    rpm = None
+    gear = None
+    if table["kind"] == "jog":
+        # Whole steps for each detent of the knob
+        exact = mm * steps_per_mm
+        ratio = Fraction(round(exact), 1)
+        used = ratio
+        rate = None
+    elif table["kind"] == "feed_rate":
+        # Steps per millisecond, which end up as 16.16 fixed point
+        exact = mm * steps_per_mm / 60000
+        ratio = approximate(exact)
+        used = Fraction((ratio * RATIO_FIXED_ONE + Fraction(1, 2)) // 1, RATIO_FIXED_ONE)
+        rate = exact
+    else:
+        # Steps per encoder count, to follow the spindle
+        exact = mm * steps_per_mm / machine["ENCODER_PULSES"]
+        ratio = approximate(exact)
+        used = ratio
+        rate = None
+        rpm = int(MAX_STEP_RATE * 60000 / (ratio * machine["ENCODER_PULSES"]))
+        # Whole steps for each cycle of the encoder's A input can be left
+        # to the timers when HARDWARE_GEARING is on, as ratio_gear() does
+        steps = ratio * GEAR_COUNTS
+        if steps.denominator == 1 and steps <= GEAR_MAX:
+            gear = int(steps)
+
+    if ratio == 0:
+        raise TableError("%s: %s is too small for a single step" % (where, value))
+    if rpm is not None and rpm < machine["PITCH_MIN_RPM"]:
+        raise TableError("%s: %s needs more than %d steps per ms above %d rpm, less than PITCH_MIN_RPM"
+                         % (where, value, MAX_STEP_RATE, rpm))
+    if rate is not None and rate > MAX_STEP_RATE:
+        raise TableError("%s: %s needs %.1f steps per ms, more than the %d that can be made"
+                         % (where, value, rate, MAX_STEP_RATE))
+
+    error = int(round((used - exact) / exact * 1000000000))
+    return {
+        "value": value,
+        "ratio": ratio,
+        "shown": shown(value, table["decimals"], where),
+        "error": error,
+        "rpm": rpm,
+        "gear": gear,
+    }
+
+
+COMMENTS = {
+    "jog": "// For jogging the ratio is the number of steps to move the carriage\n"
+           "// for each detent of the knob\n",
+    "feed_rate": "// For a fixed feed rate in mm/min the ratio is the number of steps\n"
+                 "// to make per millisecond, independent of the spindle\n",
+}
+
+
+def generate(tables, machine, config_path, pitches_path):
+    out = []
+    out.append("// Generated by tools/tables.py from %s and %s, don't edit\n"
+               % (pitches_path, config_path))
+    out.append("//\n")
+    for name in ("ENCODER_PULSES", "STEPPER_PULSES", "LEADSCREW_PITCH",
+                 "FEEDSCREW_PITCH", "DRIVE_RATIO"):
+        out.append("// %-16s %s\n" % (name, float(machine[name])))
+    out.append("// max spindle speeds are for %d steps per ms\n\n" % MAX_STEP_RATE)
+    out.append("typedef struct\n{\n")
+    out.append("\tuint32_t num;        // steps per encoder count, as for ratio_apply()\n")
+    out.append("\tuint16_t den;\n")
+    out.append("\tuint16_t value;      // as shown, in the table's decimals\n")
+    out.append("} table_entry_t;\n\n")
+    out.append("typedef struct\n{\n")
+    out.append("\tconst table_entry_t* entries;\n")
+    out.append("\tuint8_t size;\n")
+    out.append("\tuint8_t decimals;\n")
+    out.append("\tuint8_t zero;        // show leading zeros\n")
+    out.append("} table_t;\n")
+
+    for table in tables:
+        out.append("\n" + COMMENTS.get(table["kind"], ""))
+        out.append("static const table_entry_t %s[] =\n{\n" % table["name"])
+        for e in table["entries"]:
+            notes = [e["value"], "exact" if e["error"] == 0 else "%+d ppb" % e["error"]]
+            if e["rpm"] is not None:
+                notes.append("%d rpm max" % e["rpm"])
+            if e["gear"] is not None:
+                notes.append("geared %d per cycle" % e["gear"])
+            out.append("\t{ %d, %d, %d },  // %s\n" % (
+                e["ratio"].numerator, e["ratio"].denominator, e["shown"], ", ".join(notes)))
+        out.append("};\n")
+
+    out.append("\n#define TABLES %d\n\n" % len(tables))
+    out.append("static const table_t tables[TABLES] =\n{\n")
+    for table in tables:
+        out.append("\t{ %s, %d, %d, %d },\n" % (
+            table["name"], len(table["entries"]), table["decimals"],
+            1 if table["zero"] else 0))
+    out.append("};\n")
+    return "".join(out)
+
+
+def report(tables):
+    lines = ["%-18s %-12s %22s %10s %8s %6s" % ("table", "pitch", "ratio", "error ppb", "max rpm", "gear")]
+    for table in tables:
+        units = KINDS[table["kind"]][2]
+        for e in table["entries"]:
+            lines.append("%-18s %-12s %22s %10d %8s %6s" % (
+                table["name"], "%s %s" % (e["value"], units),
+                "%d/%d" % (e["ratio"].numerator, e["ratio"].denominator),
+                e["error"], e["rpm"] if e["rpm"] is not None else "-",
+                e["gear"] if e["gear"] is not None else "-"))
+    return "\n".join(lines)
+
+
+def main():
+    if len(sys.argv) != 4:
+        print("usage: %s pitches.txt config.h tables.h" % sys.argv[0], file=sys.stderr)
+        sys.exit(2)
+    pitches_path, config_path, output_path = sys.argv[1:]
+
+    try:
+        machine = read_config(config_path)
+        for name in ("ENCODER_PULSES", "STEPPER_PULSES", "LEADSCREW_PITCH",
+                     "FEEDSCREW_PITCH", "DRIVE_RATIO", "PITCH_MIN_RPM"):
+            if name not in machine:
+                raise TableError("%s: no value for %s" % (config_path, name))
+        tables = read_pitches(pitches_path)
+        for table in tables:
+            table["entries"] = [entry(table, value, where, machine)
+                                for value, where in table["values"]]
+    except TableError as e:
+        print("error: %s" % e, file=sys.stderr)
+        sys.exit(1)
+
+    with open(output_path, "w") as f:
+        f.write(generate(tables, machine, config_path, pitches_path))
+    print(report(tables))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+#
+#   Copyright (C) 2023 Stephen Robinson
+#
+#   This file is part of Sieg SC4 ELS
+#
+#   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   Sieg SC4 ELS is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this code (see the file names COPING).
+#   If not, see <http://www.gnu.org/licenses/>.
+#
+# Decodes the telemetry stream from the controller's serial port into CSV:
+#
+#   stty -F /dev/ttyUSB0 460800 raw
+#   tools/telemetry.py /dev/ttyUSB0 > log.csv
+#
+# Frames are COBS encoded and end with a zero byte. Each is a number of
+# little endian 32 bit words followed by a CRC-32 of them as calculated
+# by the STM32 CRC unit.
+
+import struct
+import sys
+
+FRAME_TELEMETRY = 1
+
+
+def crc32_stm32(words):
+    crc = 0xffffffff
+    for word in words:
+        crc ^= word
+        for _ in range(32):
+            if crc & 0x80000000:
+                crc = ((crc << 1) ^ 0x04c11db7) & 0xffffffff
+            else:
+                crc = (crc << 1) & 0xffffffff
+    return crc
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data) + 1:
+            raise ValueError("bad COBS block")
+        out += data[i + 1:i + code]
+        i += code
+        if code != 0xff and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def decode_frame(encoded):
+    data = cobs_decode(encoded)
+    if len(data) < 8 or len(data) % 4 != 0:
+        raise ValueError("bad frame length")
+    words = struct.unpack("<%dI" % (len(data) // 4), data)
+    if crc32_stm32(words[:-1]) != words[-1]:
+        raise ValueError("bad CRC")
+    return words[:-1]
+
+
+def frames(stream):
+    buffer = bytearray()
+    while True:
+        chunk = stream.read(256)
+        if not chunk:
+            return
+        for byte in chunk:
+            if byte == 0:
+                if buffer:
+                    yield bytes(buffer)
+                buffer.clear()
+            else:
+                buffer.append(byte)
+
+
+def samples(words):
+    # The samples in a telemetry frame as (tick, position, steps, lag),
+    # and how many were dropped before them
+    count = (words[0] >> 8) & 0xff
+    dropped = words[0] >> 16
+    rows = []
+    for i in range(count):
+        tick, position, packed = words[1 + i * 3:4 + i * 3]
+        steps, lag = struct.unpack("<hh", struct.pack("<I", packed))
+        rows.append((tick, position, steps, lag))
+    return dropped, rows
+
+
+def main():
+    path = sys.argv[1] if len(sys.argv) > 1 else "/dev/ttyUSB0"
+    print("tick,position,steps,lag")
+    with open(path, "rb", buffering=0) as stream:
+        for encoded in frames(stream):
+            try:
+                words = decode_frame(encoded)
+            except ValueError as e:
+                print("# %s" % e, file=sys.stderr)
+                continue
+
+            if words[0] & 0xff != FRAME_TELEMETRY:
+                continue
+            dropped, rows = samples(words)
+            if dropped:
+                print("# %d samples dropped" % dropped, file=sys.stderr)
+            for row in rows:
+                print("%d,%d,%d,%d" % row)
+            sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,108 @@
+/*
+   Copyright (C) 2023 Stephen Robinson
+  
+   This file is part of Sieg SC4 ELS
+  
+   Sieg SC4 ELS is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+  
+   Sieg SC4 ELS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this code (see the file names COPING).  
+   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stm32f103x6.h>
+
+#include "config.h"
+#include "ramfunc.h"
+#include "watchdog.h"
+
+
+#define WATCHDOG_RELOAD  ((uint16_t)(WATCHDOG_TIMEOUT * 40 / 32))   // LSI 40kHz / 32
+#define WATCHDOG_ALL     (WATCHDOG_CONTROL | WATCHDOG_MAIN)
+
+
+static volatile uint8_t heartbeats = 0;
+static uint32_t missed = 0;
+static uint8_t reset_cause = RESET_POWER;
+static uint16_t reset_count = 0;
+
+
+void watchdog_init()
+{
+	// Work out why we were reset, then clear the flags for next time
+	uint32_t flags = RCC->CSR;
+	if(flags & RCC_CSR_IWDGRSTF)
+		reset_cause = RESET_WATCHDOG;
+	else if(flags & RCC_CSR_SFTRSTF)
+		reset_cause = RESET_SOFTWARE;
+	else if(flags & RCC_CSR_PORRSTF)
+		reset_cause = RESET_POWER;
+	else if(flags & RCC_CSR_PINRSTF)
+		reset_cause = RESET_PIN;
+	else
+		reset_cause = RESET_OTHER;
+	RCC->CSR |= RCC_CSR_RMVF;
+
+	// Watchdog resets are counted in a backup register, which keeps
+	// its value through resets but not through a power cycle
+	RCC->APB1ENR |= RCC_APB1ENR_PWREN | RCC_APB1ENR_BKPEN;
+	PWR->CR |= PWR_CR_DBP;
+	if(reset_cause == RESET_POWER)
+		BKP->DR1 = 0;
+	else if(reset_cause == RESET_WATCHDOG)
+		BKP->DR1 += 1;
+	reset_count = BKP->DR1;
+
+	// Don't reset while stopped in the debugger
+	DBGMCU->CR |= DBGMCU_CR_DBG_IWDG_STOP;
+
+	IWDG->KR = 0xCCCC;              // start, also starts the LSI
+	IWDG->KR = 0x5555;              // unlock the registers
+	IWDG->PR = 3;                   // prescaler = 32
+	IWDG->RLR = WATCHDOG_RELOAD;
+	while(IWDG->SR != 0)
+		;
+	IWDG->KR = 0xAAAA;              // reload
+}
+
+RAMFUNC void watchdog_checkin(uint8_t source)
+{
+	heartbeats |= source;
+}
+
+RAMFUNC uint8_t watchdog_update()
+{
+	// Only reload the watchdog once everything has checked in, so a hang
+	// anywhere lets it run out
+	if((heartbeats & WATCHDOG_ALL) == WATCHDOG_ALL)
+	{
+		IWDG->KR = 0xAAAA;
+		heartbeats = 0;
+		missed = 0;
+	}
+	else if(missed < WATCHDOG_STALL_TIME)
+	{
+		++missed;
+	}
+
+	return missed < WATCHDOG_STALL_TIME;
+}
+
+uint8_t watchdog_reset_cause()
+{
+	return reset_cause;
+}
+
+uint16_t watchdog_reset_count()
+{
+	return reset_count;
+}
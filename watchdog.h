@@ -0,0 +1,14 @@
+#define WATCHDOG_CONTROL  0x01
+#define WATCHDOG_MAIN     0x02
+
+#define RESET_POWER       0
+#define RESET_PIN         1
+#define RESET_SOFTWARE    2
+#define RESET_WATCHDOG    3
+#define RESET_OTHER       4
+
+void watchdog_init();
+void watchdog_checkin(uint8_t source);
+uint8_t watchdog_update();
+uint8_t watchdog_reset_cause();
+uint16_t watchdog_reset_count();